@@ -0,0 +1,814 @@
+/*
+    amr.hpp
+
+    Block-structured mesh refinement for the FDTD solver in sonar_sim.hpp.
+
+    The domain is covered by a hierarchy of grids, each twice as coarse as
+    the next. The finest grid has the cells of a Simulation with the same
+    SimConfig, but it only computes the tiles that need it: around the
+    array and the lobe sample ring, along reflecting walls and around
+    moving targets. Every coarser grid computes the tiles of the next finer
+    one plus a buffer around them, and the coarsest covers the domain. All
+    grids run the same update at the same Courant number, so a grid takes
+    two steps for every step of the one above it (Berger-Oliger
+    subcycling).
+
+    Coupling between a grid and the next finer one:
+      - the ring of ghost cells around the fine tiles is interpolated from
+        the coarse grid, quadratically in space and in time;
+      - after the fine grid caught up, every coarse cell under it becomes
+        the mean of its four children, and the coarse cells along the
+        interface are corrected so the flux that crossed it is the one the
+        fine grid saw (refluxing). What leaves one grid enters the other;
+      - a few cells either side of every interface are smoothed, which
+        removes the grid-scale checkerboard the interface would otherwise
+        trap and amplify.
+    Moving targets and walls live on the finest grid, which is re-tiled
+    whenever a target has moved half its margin.
+
+    Waves that leave the finest grid travel on coarser ones, with their
+    larger dispersion. That costs nothing in open water, but echoes from a
+    reflecting domain border come back through the coarsest grid, so
+    refl_coef > 0 needs more cells per wavelength there (see amr_beam).
+
+    RefinedSimulation has the time stepping interface of Simulation: one
+    step() is one fine time step, and coordinates are fine cells.
+*/
+#ifndef __SONAR_AMR_HPP
+#define __SONAR_AMR_HPP
+
+#include "sonar_sim.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+class RefinedSimulation {
+public:
+  struct Options {
+    int levels = 3;  // grids, each twice as coarse as the next
+    int margin = 32; // finest cells kept around the lobe ring, walls and targets
+  };
+
+  static const int TILE = 8;        // cells per side of a refinement tile
+  static const int BUFFER = 4;      // coarse cells kept around a finer grid
+  static const int FILTER_BAND = 6; // cells filtered on either side of an interface
+  static constexpr float FILTER = 0.2f;
+
+  const SimConfig config;
+  const int width; // fine cells, as in a Simulation of this config
+  const int height;
+
+  // The interior of the grid must split into whole cells of the coarsest
+  // grid; fit() shrinks a config to the next size that does
+  static SimConfig fit(SimConfig config, int levels) {
+    const int s = 1 << (levels - 1);
+    config.width = (config.width - 2) / s * s + 2;
+    config.height = (config.height - 2) / s * s + 2;
+    return config;
+  }
+
+  RefinedSimulation(const SimConfig &config, const Options &options)
+      : config(fit(config, options.levels)), width(this->config.width),
+        height(this->config.height), options(options), dt(config.dt()),
+        dx(config.dx()), lf(config.lf()), waveform(config.waveform()) {
+    for (int l = 0; l < options.levels; ++l) {
+      levels.emplace_back(1 << (options.levels - 1 - l), width, height);
+    }
+    Level &fine = levels.back();
+    // Same walls and targets as Simulation
+    Simulation shape(this->config);
+    for (int y = 0; y < height; ++y) {
+      for (int x = 0; x < width; ++x) {
+        fine.cells[fine.index(x, y)].wall = shape.cell(x, y).wall;
+      }
+    }
+    for (const TargetSpec &t : config.targets) {
+      targets.emplace_back(t.x, t.y, t.vx, t.vy, ellipse_shape(t.rx, t.ry));
+    }
+    update_moving_targets(0.0f);
+    for (Level &level : levels) {
+      for (int y = 1; y < level.height - 1; ++y) {
+        for (int x = 1; x < level.width - 1; ++x) {
+          level.cells[level.index(x, y)].k = compute_cell_k(level, x, y);
+        }
+      }
+    }
+    Level &base = levels.front();
+    base.active.assign(base.cells.size(), 0);
+    for (int y = 1; y < base.height - 1; ++y) {
+      for (int x = 1; x < base.width - 1; ++x) {
+        base.active[base.index(x, y)] = 1;
+      }
+    }
+    regrid();
+  }
+
+  float time_step() const { return dt; }
+  int level_count() const { return static_cast<int>(levels.size()); }
+
+  // Cells computed so far, on all grids
+  uint64_t cell_updates() const { return updates; }
+
+  // Cells of grid l (0 is the coarsest) currently refined to it
+  int active_cells(int l) const {
+    return static_cast<int>(std::count(levels[l].active.begin(), levels[l].active.end(), 1));
+  }
+
+  std::vector<int> array_elements() const { return array_columns(width); }
+  int array_y() const { return height - 2; }
+
+  void apply_pulse(float time) {
+    Level &fine = levels.back();
+    float element_delay = config.element_phase() / (2 * PI_F * config.pulse_freq);
+    std::vector<int> xs = array_elements();
+    for (size_t n = 0; n < xs.size(); ++n) {
+      const int i = fine.index(xs[n], array_y());
+      if (fine.cells[i].targets > 0) {
+        continue;
+      }
+      fine.u[i] = waveform.value(time + element_delay * n);
+    }
+  }
+
+  // Pressure at fine cell x, y from the finest grid that computes it; a
+  // coarser grid is interpolated to the current fine time
+  float read_pressure(int x, int y) const {
+    for (int l = level_count() - 1; l >= 0; --l) {
+      const Level &level = levels[l];
+      const int i = level.index(level.cell_of(x), level.cell_of(y));
+      if (!level.active[i]) {
+        continue;
+      }
+      const int phase = count % level.scale;
+      if (phase == 0) {
+        return level.u[i];
+      }
+      float w[3];
+      time_weights(float(phase) / level.scale, w);
+      return w[0] * level.u_next[i] + w[1] * level.u_prev[i] + w[2] * level.u[i];
+    }
+    return 0.0f;
+  }
+
+  // Same sample points as Simulation::lobe_point
+  std::pair<int, int> lobe_point(int degree) const {
+    int r = config.lobe_radius;
+    int x = width/2 - static_cast<int>(r*std::cos(deg2rad(degree)));
+    int y = height-2 - static_cast<int>(r*std::sin(deg2rad(degree)));
+    return std::make_pair(x, y);
+  }
+
+  void read_lobes(std::vector<float> &lobes_pressure) const {
+    lobes_pressure.resize(180);
+    for (int i = 0; i < 180; ++i) {
+      std::pair<int, int> p = lobe_point(i);
+      lobes_pressure[i] = read_pressure(p.first, p.second);
+    }
+  }
+
+  // Advance one fine time step. A grid steps whenever the fine step count
+  // is a multiple of its scale: coarse grids first, each one after the
+  // finer grid below it has been folded back into it.
+  void step() {
+    const int n = level_count();
+    if (count > 0) {
+      for (int l = n - 2; l >= 0; --l) {
+        if (count % levels[l].scale == 0) {
+          synchronize(l);
+        }
+      }
+    }
+    if (count % levels[0].scale == 0 && count > 0 && targets_moved()) {
+      regrid();
+    }
+    for (int l = 0; l < n; ++l) {
+      Level &level = levels[l];
+      if (count % level.scale != 0) {
+        continue;
+      }
+      if (l > 0) {
+        const Level &parent = levels[l - 1];
+        fill_ghosts(l, float(count % parent.scale) / parent.scale);
+        add_fine_flux(l, count % parent.scale == 0);
+      }
+      if (l + 1 < n) {
+        record_coarse_flux(l);
+      }
+      if (l + 1 == n) {
+        update_moving_targets(dt);
+      }
+      step_level(level);
+    }
+    ++count;
+  }
+
+private:
+  struct Span {
+    int begin, end; // cell indices [begin, end) on one row
+  };
+
+  // An interface face between a coarse cell outside the finer grid and
+  // one under it, with the two fine faces that make it up
+  struct Face {
+    int out, in;         // coarse cells
+    int fine_in[2];      // fine cells inside, next to the face
+    int fine_out[2];     // ghost cells across it
+  };
+
+  struct Ghost {
+    int i;      // ghost cell
+    int parent; // coarse cell over it
+    int dx, dy; // which quarter of the parent: -1 or 1
+  };
+
+  // One grid of the hierarchy, covering the whole domain. Cell x covers
+  // fine cells [scale (x - 1) + 1, scale x + 1), so cell 0 and the last
+  // one are the border ring, outside the fine grid's interior like the
+  // Simulation border.
+  struct Level {
+    int scale;
+    int width;
+    int height;
+    std::vector<Cell> cells;
+    std::vector<float> u;
+    std::vector<float> u_prev;
+    std::vector<float> u_next;
+    std::vector<unsigned char> active;  // refined to this grid
+    std::vector<unsigned char> covered; // active on the next finer grid
+    std::vector<Span> spans;            // the cells step_level computes
+    std::vector<Ghost> ghosts;          // filled from the coarser grid
+    std::vector<int> filtered;          // computed cells near an interface
+    std::vector<float> filtered_value;
+    std::vector<Face> faces;            // with the next finer grid
+    std::vector<float> fine_flux;       // per face, summed over fine steps
+    std::vector<float> coarse_flux;     // per face, at the last coarse step
+    std::vector<float> carry_flux;      // per face, the fine step that ends a coarse one
+    std::vector<float> last_flux;       // carry_flux of the coarse step before
+    uint64_t computed = 0;              // cells in spans
+
+    Level(int scale, int fine_width, int fine_height)
+        : scale(scale), width((fine_width - 2) / scale + 2),
+          height((fine_height - 2) / scale + 2), cells(width * height),
+          u(width * height, 0.0f), u_prev(width * height, 0.0f),
+          u_next(width * height, 0.0f), active(width * height, 0),
+          covered(width * height, 0) {}
+
+    int index(int x, int y) const { return y * width + x; }
+
+    // Cell of this grid that fine cell x (or y) lies in
+    int cell_of(int fine) const {
+      return fine <= 0 ? 0 : (fine - 1) / scale + 1;
+    }
+  };
+
+  Options options;
+  float dt;
+  float dx;
+  float lf;
+  Waveform waveform;
+  std::vector<Level> levels; // coarsest first
+  std::vector<MovingTarget> targets;
+  std::vector<std::pair<int, int>> changed_cells;
+  std::vector<std::pair<int, int>> tiled_at; // target centres at the last regrid
+  long long count = 0; // fine steps taken
+  uint64_t updates = 0;
+
+  bool is_blocking(const Cell &cell) const {
+    return (cell.wall && !config.visual_wall) || cell.targets > 0;
+  }
+
+  bool is_updated(const Cell &cell) const {
+    return (!cell.wall || config.visual_wall) && cell.targets == 0;
+  }
+
+  int compute_cell_k(const Level &level, int x, int y) const {
+    int k = 4;
+    if (y == 1 || y == level.height - 2) {
+      k -= 1;
+    }
+    if (x == 1 || x == level.width - 2) {
+      k -= 1;
+    }
+    if (is_blocking(level.cells[level.index(x + 1, y)])) k -= 1;
+    if (is_blocking(level.cells[level.index(x - 1, y)])) k -= 1;
+    if (is_blocking(level.cells[level.index(x, y + 1)])) k -= 1;
+    if (is_blocking(level.cells[level.index(x, y - 1)])) k -= 1;
+    return k;
+  }
+
+  // Smooth both time levels of the cells near an interface with
+  // 1 - FILTER (d4x + d4y) / 16. The scheme runs at its stability limit,
+  // where the grid's checkerboard is a double root: the interface can't
+  // pass that mode on, so it would stay trapped between interfaces and
+  // grow. The same filter on u and u_prev only ever takes energy out of a
+  // mode. A wave with ten cells per wavelength loses 0.2% of its
+  // amplitude per step inside the band, one with twenty 0.01%.
+  void filter_level(Level &level) {
+    const int width = level.width;
+    const float a = FILTER / 16;
+    for (std::vector<float> *values : {&level.u, &level.u_prev}) {
+      const std::vector<float> &v = *values;
+      level.filtered_value.resize(level.filtered.size());
+      for (size_t n = 0; n < level.filtered.size(); ++n) {
+        const int i = level.filtered[n];
+        const float d4x = v[i - 2] - 4 * v[i - 1] + 6 * v[i] - 4 * v[i + 1] + v[i + 2];
+        const float d4y = v[i - 2 * width] - 4 * v[i - width] + 6 * v[i] -
+                          4 * v[i + width] + v[i + 2 * width];
+        level.filtered_value[n] = v[i] - a * (d4x + d4y);
+      }
+      for (size_t n = 0; n < level.filtered.size(); ++n) {
+        (*values)[level.filtered[n]] = level.filtered_value[n];
+      }
+    }
+  }
+
+  // Simulation::step on the computed cells of one grid
+  void step_level(Level &level) {
+    filter_level(level);
+    const std::vector<float> &u = level.u;
+    const std::vector<float> &u_prev = level.u_prev;
+    const int width = level.width;
+    for (const Span &span : level.spans) {
+      for (int i = span.begin; i < span.end; ++i) {
+        if (!is_updated(level.cells[i])) {
+          continue;
+        }
+        const int k = level.cells[i].k;
+        level.u_next[i] =
+          (1 / (1 + lf * (4 - k))) * ((2 - 0.5 * k) * u[i] +
+          0.5 * (u[i + 1] + u[i - 1] +
+          u[i + width] + u[i - width]) +
+          (lf * (4 - k) - 1) * u_prev[i]);
+      }
+    }
+    std::swap(level.u_prev, level.u);
+    std::swap(level.u, level.u_next);
+    updates += level.computed;
+  }
+
+  // Lagrange weights for the three time levels u_next, u_prev, u of a
+  // grid at t = -1, 0, 1, evaluated at t = theta
+  static void time_weights(float theta, float w[3]) {
+    w[0] = 0.5f * theta * (theta - 1.0f);
+    w[1] = 1.0f - theta * theta;
+    w[2] = 0.5f * theta * (theta + 1.0f);
+  }
+
+  // Per-axis weights over parent offsets -2..2 for a child a quarter
+  // cell to the side d (-1 or 1) of parent p along an axis of n cells
+  void axis_weights(int p, int n, int d, float w[5]) const {
+    for (int i = 0; i < 5; ++i) w[i] = 0.0f;
+    const float q[3] = {5.0f / 32, 15.0f / 16, -3.0f / 32};
+    for (int i = 0; i < 3; ++i) {
+      if (d < 0) w[1 + i] = q[i]; else w[3 - i] = q[i];
+    }
+    // Extrapolate over the border ring: v(-1) = 2 v(0) - v(1)
+    if (p == 1) { w[2] += 2 * w[1]; w[3] -= w[1]; w[1] = 0.0f; }
+    if (p == n - 2) { w[2] += 2 * w[3]; w[1] -= w[3]; w[3] = 0.0f; }
+  }
+
+  float interpolate(const Level &parent, int p, int dx, int dy, const float w[3]) const {
+    float wx[5];
+    float wy[5];
+    axis_weights(p % parent.width, parent.width, dx, wx);
+    axis_weights(p / parent.width, parent.height, dy, wy);
+    float sum = 0.0f;
+    for (int j = 0; j < 5; ++j) {
+      if (wy[j] == 0.0f) continue;
+      float row = 0.0f;
+      for (int i = 0; i < 5; ++i) {
+        if (wx[i] == 0.0f) continue;
+        const int q = p + (j - 2) * parent.width + i - 2;
+        row += wx[i] * (w[0] * parent.u_next[q] + w[1] * parent.u_prev[q] + w[2] * parent.u[q]);
+      }
+      sum += wy[j] * row;
+    }
+    return sum;
+  }
+
+  void fill_ghosts(int l, float theta) {
+    Level &level = levels[l];
+    const Level &parent = levels[l - 1];
+    float w[3];
+    time_weights(theta, w);
+    for (const Ghost &g : level.ghosts) {
+      level.u[g.i] = interpolate(parent, g.parent, g.dx, g.dy, w);
+    }
+  }
+
+  // Flux into the coarse side of every interface face, from the fine
+  // grid's current step
+  void add_fine_flux(int l, bool first) {
+    Level &parent = levels[l - 1];
+    const Level &level = levels[l];
+    for (size_t f = 0; f < parent.faces.size(); ++f) {
+      const Face &face = parent.faces[f];
+      float sum = 0.0f;
+      for (int e = 0; e < 2; ++e) {
+        const Cell &in = level.cells[face.fine_in[e]];
+        const Cell &out = level.cells[face.fine_out[e]];
+        if (!is_blocking(in) && !is_blocking(out)) {
+          sum += level.u[face.fine_in[e]] - level.u[face.fine_out[e]];
+        }
+      }
+      if (first) {
+        parent.fine_flux[f] += sum;
+      } else {
+        parent.fine_flux[f] += 0.5f * sum;
+        parent.carry_flux[f] = sum;
+      }
+    }
+  }
+
+  void record_coarse_flux(int l) {
+    Level &level = levels[l];
+    for (size_t f = 0; f < level.faces.size(); ++f) {
+      const Face &face = level.faces[f];
+      level.coarse_flux[f] = level.u[face.in] - level.u[face.out];
+    }
+  }
+
+  // Fold grid l + 1, which has caught up with grid l, back into it: every
+  // covered cell becomes the mean of its four children, and the cells
+  // outside the interface are corrected so the flux that crossed it over
+  // the coarse step is the one the finer grid saw. The flux of the fine
+  // step that ends a coarse step is split between that coarse step and the
+  // next, so both are centred on their coarse step.
+  void synchronize(int l) {
+    Level &level = levels[l];
+    const Level &fine = levels[l + 1];
+    for (int y = 1; y < level.height - 1; ++y) {
+      for (int x = 1; x < level.width - 1; ++x) {
+        const int p = level.index(x, y);
+        if (!level.covered[p]) {
+          continue;
+        }
+        const int c = fine.index(2 * x - 1, 2 * y - 1);
+        level.u[p] = 0.25f * (fine.u[c] + fine.u[c + 1] + fine.u[c + fine.width] +
+                              fine.u[c + fine.width + 1]);
+      }
+    }
+    for (size_t f = 0; f < level.faces.size(); ++f) {
+      const Face &face = level.faces[f];
+      const int k = level.cells[face.out].k;
+      const float fine_sum = level.fine_flux[f] + 0.5f * level.last_flux[f];
+      level.u[face.out] += 0.25f * (fine_sum - 2.0f * level.coarse_flux[f]) /
+                           (1 + lf * (4 - k));
+      level.fine_flux[f] = 0.0f;
+      level.last_flux[f] = level.carry_flux[f];
+    }
+  }
+
+  // Targets on the finest grid, as Simulation::update_moving_targets
+  void set_cell_targets(int x, int y, int delta) {
+    Level &fine = levels.back();
+    if (x < 1 || x > width - 2 || y < 1 || y > height - 2) {
+      return;
+    }
+    const int i = fine.index(x, y);
+    int before = fine.cells[i].targets;
+    int after = before + delta;
+    fine.cells[i].targets = after;
+    if ((before == 0) != (after == 0)) {
+      fine.u[i] = 0.0f;
+      fine.u_prev[i] = 0.0f;
+      fine.u_next[i] = 0.0f;
+      changed_cells.push_back(std::make_pair(x, y));
+    }
+  }
+
+  void update_moving_targets(float step_dt) {
+    Level &fine = levels.back();
+    changed_cells.clear();
+    for (MovingTarget &target : targets) {
+      target.x += target.vx * step_dt / dx;
+      target.y += target.vy * step_dt / dx;
+      int cx = static_cast<int>(std::lround(target.x));
+      int cy = static_cast<int>(std::lround(target.y));
+      if (target.placed && cx == target.cx && cy == target.cy) {
+        continue;
+      }
+      for (const auto &offset : target.shape) {
+        set_cell_targets(cx + offset.first, cy + offset.second, 1);
+      }
+      if (target.placed) {
+        for (const auto &offset : target.shape) {
+          set_cell_targets(target.cx + offset.first, target.cy + offset.second, -1);
+        }
+      }
+      target.cx = cx;
+      target.cy = cy;
+      target.placed = true;
+    }
+    for (const auto &c : changed_cells) {
+      const std::pair<int, int> around[] = {{c.first, c.second},
+                                            {c.first + 1, c.second},
+                                            {c.first - 1, c.second},
+                                            {c.first, c.second + 1},
+                                            {c.first, c.second - 1}};
+      for (const auto &a : around) {
+        if (a.first >= 1 && a.first <= width - 2 && a.second >= 1 && a.second <= height - 2) {
+          fine.cells[fine.index(a.first, a.second)].k = compute_cell_k(fine, a.first, a.second);
+        }
+      }
+    }
+  }
+
+  bool targets_moved() const {
+    for (size_t t = 0; t < targets.size(); ++t) {
+      if (std::abs(targets[t].cx - tiled_at[t].first) * 2 > options.margin ||
+          std::abs(targets[t].cy - tiled_at[t].second) * 2 > options.margin) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Tiles of grid l: tile tx, ty covers cells [TILE tx + 1, TILE tx + TILE + 1)
+  static void mark_tiles(const Level &level, std::vector<unsigned char> &tiles, int tiles_x,
+                         int x0, int y0, int x1, int y1) {
+    const int tiles_y = static_cast<int>(tiles.size()) / tiles_x;
+    const int tx0 = std::max(0, (x0 - 1) / TILE);
+    const int ty0 = std::max(0, (y0 - 1) / TILE);
+    const int tx1 = std::min(tiles_x - 1, (std::max(x1, 1) - 1) / TILE);
+    const int ty1 = std::min(tiles_y - 1, (std::max(y1, 1) - 1) / TILE);
+    for (int ty = ty0; ty <= ty1; ++ty) {
+      for (int tx = tx0; tx <= tx1; ++tx) {
+        tiles[ty * tiles_x + tx] = 1;
+      }
+    }
+    (void)level;
+  }
+
+  // Work out which tiles every grid but the coarsest refines, bring newly
+  // refined cells up from the coarser grid and rebuild the interfaces.
+  // Only called when all grids are at the same time.
+  void regrid() {
+    const int n = level_count();
+    tiled_at.clear();
+    for (const MovingTarget &target : targets) {
+      tiled_at.emplace_back(target.cx, target.cy);
+    }
+    std::vector<std::vector<unsigned char>> tiles(n);
+    std::vector<int> tiles_x(n);
+    for (int l = 1; l < n; ++l) {
+      const Level &level = levels[l];
+      tiles_x[l] = (level.width - 2 + TILE - 1) / TILE;
+      const int tiles_y = (level.height - 2 + TILE - 1) / TILE;
+      tiles[l].assign(tiles_x[l] * tiles_y, 0);
+    }
+    if (n > 1) {
+      // Finest grid: the array and the lobe ring, walls that reflect and
+      // targets, each with the margin around it
+      const Level &fine = levels.back();
+      std::vector<unsigned char> &t = tiles.back();
+      const int m = options.margin;
+      const int r = config.lobe_radius + m;
+      const int cx = width / 2;
+      const int cy = array_y();
+      for (int y = std::max(1, cy - r); y <= std::min(height - 2, cy + r); ++y) {
+        const int half = static_cast<int>(std::sqrt(float(r * r - (y - cy) * (y - cy))));
+        mark_tiles(fine, t, tiles_x.back(), cx - half, y, cx + half, y);
+      }
+      for (int y = 1; y < height - 1; ++y) {
+        for (int x = 1; x < width - 1; ++x) {
+          const Cell &cell = fine.cells[fine.index(x, y)];
+          if (cell.wall && !config.visual_wall) {
+            mark_tiles(fine, t, tiles_x.back(), x - m, y - m, x + m, y + m);
+          }
+        }
+      }
+      for (const MovingTarget &target : targets) {
+        for (const auto &offset : target.shape) {
+          const int x = target.cx + offset.first;
+          const int y = target.cy + offset.second;
+          mark_tiles(fine, t, tiles_x.back(), x - m, y - m, x + m, y + m);
+        }
+      }
+    }
+    // Coarser grids take the next finer one's tiles and a buffer around them
+    for (int l = n - 2; l >= 1; --l) {
+      const Level &child = levels[l + 1];
+      const int b = BUFFER;
+      const int child_tiles_y = static_cast<int>(tiles[l + 1].size()) / tiles_x[l + 1];
+      for (int ty = 0; ty < child_tiles_y; ++ty) {
+        for (int tx = 0; tx < tiles_x[l + 1]; ++tx) {
+          if (!tiles[l + 1][ty * tiles_x[l + 1] + tx]) {
+            continue;
+          }
+          // Child tile cells [TILE tx + 1, TILE tx + TILE + 1) lie in
+          // parent cells [TILE tx / 2 + 1, TILE tx / 2 + TILE / 2 + 1)
+          const int x0 = TILE * tx / 2 + 1;
+          const int y0 = TILE * ty / 2 + 1;
+          mark_tiles(levels[l], tiles[l], tiles_x[l], x0 - b, y0 - b,
+                     x0 + TILE / 2 - 1 + b, y0 + TILE / 2 - 1 + b);
+        }
+      }
+      (void)child;
+    }
+
+    for (int l = 1; l < n; ++l) {
+      Level &level = levels[l];
+      const Level &parent = levels[l - 1];
+      std::vector<unsigned char> active(level.cells.size(), 0);
+      for (int y = 1; y < level.height - 1; ++y) {
+        for (int x = 1; x < level.width - 1; ++x) {
+          active[level.index(x, y)] = tiles[l][((y - 1) / TILE) * tiles_x[l] + (x - 1) / TILE];
+        }
+      }
+      // Newly refined cells start from the coarser grid: u at its time,
+      // u_prev halfway back to its u_prev, u_next at its u_prev
+      const float now[3] = {0.0f, 0.0f, 1.0f};
+      float half[3];
+      time_weights(0.5f, half);
+      const float before[3] = {0.0f, 1.0f, 0.0f};
+      for (int y = 1; y < level.height - 1; ++y) {
+        for (int x = 1; x < level.width - 1; ++x) {
+          const int i = level.index(x, y);
+          if (!active[i] || level.active[i]) {
+            continue;
+          }
+          if (!is_updated(level.cells[i])) {
+            level.u[i] = level.u_prev[i] = level.u_next[i] = 0.0f;
+            continue;
+          }
+          const int p = parent.index((x - 1) / 2 + 1, (y - 1) / 2 + 1);
+          const int qx = (x - 1) % 2 ? 1 : -1;
+          const int qy = (y - 1) % 2 ? 1 : -1;
+          level.u[i] = interpolate(parent, p, qx, qy, now);
+          level.u_prev[i] = interpolate(parent, p, qx, qy, half);
+          level.u_next[i] = interpolate(parent, p, qx, qy, before);
+        }
+      }
+      level.active.swap(active);
+    }
+    for (int l = 0; l < n; ++l) {
+      rebuild(l);
+    }
+  }
+
+  // Covered cells, computed spans, ghosts and interface faces of grid l
+  // from the active masks
+  void rebuild(int l) {
+    Level &level = levels[l];
+    const int n = level_count();
+    const int w = level.width;
+    std::fill(level.covered.begin(), level.covered.end(), 0);
+    if (l + 1 < n) {
+      const Level &child = levels[l + 1];
+      for (int y = 1; y < level.height - 1; ++y) {
+        for (int x = 1; x < w - 1; ++x) {
+          level.covered[level.index(x, y)] = child.active[child.index(2 * x - 1, 2 * y - 1)];
+        }
+      }
+    }
+    // A covered cell is only computed next to uncovered ones, where the
+    // finer grid's ghosts interpolate its new value; the rest are
+    // restricted before anything reads them
+    level.spans.clear();
+    level.computed = 0;
+    for (int y = 1; y < level.height - 1; ++y) {
+      int begin = -1;
+      for (int x = 1; x <= w - 1; ++x) {
+        const int i = level.index(x, y);
+        bool compute = x < w - 1 && level.active[i];
+        if (compute && level.covered[i]) {
+          bool deep = true;
+          for (int j = -2; j <= 2 && deep; ++j) {
+            for (int k = -2; k <= 2; ++k) {
+              const int q = i + j * w + k;
+              if (q >= 0 && q < static_cast<int>(level.active.size()) && level.active[q] &&
+                  !level.covered[q]) {
+                deep = false;
+                break;
+              }
+            }
+          }
+          compute = !deep;
+        }
+        if (compute && begin < 0) {
+          begin = i;
+        } else if (!compute && begin >= 0) {
+          level.spans.push_back(Span{begin, i});
+          level.computed += i - begin;
+          begin = -1;
+        }
+      }
+    }
+    level.ghosts.clear();
+    if (l > 0) {
+      const Level &parent = levels[l - 1];
+      for (int y = 1; y < level.height - 1; ++y) {
+        for (int x = 1; x < w - 1; ++x) {
+          const int i = level.index(x, y);
+          if (level.active[i]) {
+            continue;
+          }
+          bool next_to_active = false;
+          for (int j = -2; j <= 2; ++j) {
+            for (int k = -2; k <= 2; ++k) {
+              const int q = i + j * w + k;
+              if (q >= 0 && q < static_cast<int>(level.active.size())) {
+                next_to_active = next_to_active || level.active[q];
+              }
+            }
+          }
+          if (next_to_active) {
+            level.ghosts.push_back(Ghost{i, parent.index((x - 1) / 2 + 1, (y - 1) / 2 + 1),
+                                         (x - 1) % 2 ? 1 : -1, (y - 1) % 2 ? 1 : -1});
+          }
+        }
+      }
+    }
+    // Computed cells within FILTER_BAND of the coarser or the finer grid
+    level.filtered.clear();
+    std::vector<unsigned char> computed(level.cells.size(), 0);
+    for (const Span &span : level.spans) {
+      std::fill(computed.begin() + span.begin, computed.begin() + span.end, 1);
+    }
+    const int b = FILTER_BAND;
+    for (int y = 3; y < level.height - 3; ++y) {
+      for (int x = 3; x < w - 3; ++x) {
+        const int i = level.index(x, y);
+        if (!computed[i]) {
+          continue;
+        }
+        bool near = false;
+        for (int yy = std::max(1, y - b); yy <= std::min(level.height - 2, y + b) && !near; ++yy) {
+          for (int xx = std::max(1, x - b); xx <= std::min(w - 2, x + b); ++xx) {
+            const int q = level.index(xx, yy);
+            if (!level.active[q] || level.covered[q]) {
+              near = true;
+              break;
+            }
+          }
+        }
+        if (near) {
+          level.filtered.push_back(i);
+        }
+      }
+    }
+    level.faces.clear();
+    if (l + 1 < n) {
+      const Level &child = levels[l + 1];
+      const int cw = child.width;
+      for (int y = 1; y < level.height - 1; ++y) {
+        for (int x = 1; x < w - 1; ++x) {
+          const int out = level.index(x, y);
+          if (!level.active[out] || level.covered[out]) {
+            continue;
+          }
+          const int dirs[4][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+          for (const auto &d : dirs) {
+            const int in = level.index(x + d[0], y + d[1]);
+            if (!level.covered[in]) {
+              continue;
+            }
+            Face face;
+            face.out = out;
+            face.in = in;
+            for (int e = 0; e < 2; ++e) {
+              // Children of out along the face, and their neighbours in in
+              int fx, fy;
+              if (d[0] != 0) {
+                fx = d[0] > 0 ? 2 * x : 2 * x - 1;
+                fy = 2 * y - 1 + e;
+              } else {
+                fx = 2 * x - 1 + e;
+                fy = d[1] > 0 ? 2 * y : 2 * y - 1;
+              }
+              face.fine_out[e] = fy * cw + fx;
+              face.fine_in[e] = (fy + d[1]) * cw + fx + d[0];
+            }
+            level.faces.push_back(face);
+          }
+        }
+      }
+    }
+    level.fine_flux.assign(level.faces.size(), 0.0f);
+    level.coarse_flux.assign(level.faces.size(), 0.0f);
+    level.carry_flux.assign(level.faces.size(), 0.0f);
+    level.last_flux.assign(level.faces.size(), 0.0f);
+  }
+};
+
+// run_simulation on a refined grid; the matching uniform run is
+// run_simulation of RefinedSimulation::fit(config, options.levels).
+// Returns an empty result if config.invalid().
+inline SimResult run_refined(const SimConfig &config,
+                             const RefinedSimulation::Options &options,
+                             uint64_t *cell_updates = nullptr) {
+  if (config.invalid()) {
+    return SimResult();
+  }
+  RefinedSimulation sim(config, options);
+  SimResult result = run_steps(sim, sim.config);
+  if (cell_updates) {
+    *cell_updates = sim.cell_updates();
+  }
+  return result;
+}
+
+#endif // __SONAR_AMR_HPP
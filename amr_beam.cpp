@@ -0,0 +1,143 @@
+#include "amr.hpp"
+#include "sonar_sim.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+// Beam pattern of a large open-water domain on a refined grid: full
+// resolution only around the array and the lobe ring, coarser grids
+// everywhere else.
+//
+//   amr_beam [--size CELLS] [--levels N] [--margin CELLS] [--steps N]
+//            [--angle DEG] [--spf N] [--refl R] [--compare 1]
+//
+// --levels defaults to the most the frequency allows: a wavelength is
+// spf / sqrt 2 fine cells, 2^(levels - 1) times fewer on the coarsest
+// grid, and below MIN_BASE_CELLS_PER_WAVELENGTH the pattern mostly shows
+// how badly the wave crosses into it, so such runs are refused. --spf
+// defaults to 40 here, which gives 3 levels.
+// --margin is how far the full resolution reaches past the lobe ring.
+// --refl defaults to 0: echoes from a reflecting border cross the domain
+// on the coarsest grid, and at --refl 0.7 the lobes are off by about 20%.
+// --compare also runs the uniform grid, for the cost and the difference.
+// At the defaults (800 cells, 3 levels, margin 32) the refined grid does
+// about 29x fewer cell updates and its lobes are within about 2.5% of the
+// peak of the uniform grid's; amr_check tests that.
+
+const double MIN_BASE_CELLS_PER_WAVELENGTH = 6.0;
+
+void print_usage() {
+  std::cerr << "usage: amr_beam [--size CELLS] [--levels N] [--margin CELLS] [--steps N]"
+               " [--angle DEG] [--spf N] [--refl R] [--compare 1]\n";
+}
+
+double base_cells_per_wavelength(const SimConfig &config, int levels) {
+  return config.sim_per_freq * std::sqrt(0.5) / (1 << (levels - 1));
+}
+
+int main(int argc, char *argv[]) {
+  SimConfig config;
+  config.width = 800;
+  config.height = 800;
+  config.sim_per_freq = 40;
+  config.refl_coef = 0.0f;
+  RefinedSimulation::Options options;
+  options.levels = 0;
+  bool compare = false;
+
+  for (int i = 1; i + 1 < argc; i += 2) {
+    const char *arg = argv[i];
+    const char *value = argv[i + 1];
+    if (!std::strcmp(arg, "--size")) {
+      config.width = config.height = std::atoi(value);
+    } else if (!std::strcmp(arg, "--levels")) {
+      options.levels = std::atoi(value);
+    } else if (!std::strcmp(arg, "--margin")) {
+      options.margin = std::atoi(value);
+    } else if (!std::strcmp(arg, "--steps")) {
+      config.steps = std::atoi(value);
+    } else if (!std::strcmp(arg, "--angle")) {
+      config.steer_angle = std::atof(value);
+    } else if (!std::strcmp(arg, "--spf")) {
+      config.sim_per_freq = std::atoi(value);
+    } else if (!std::strcmp(arg, "--refl")) {
+      config.refl_coef = std::atof(value);
+    } else if (!std::strcmp(arg, "--compare")) {
+      compare = std::atoi(value) != 0;
+    } else {
+      print_usage();
+      return 1;
+    }
+  }
+  if (options.levels == 0) {
+    options.levels = 1;
+    while (base_cells_per_wavelength(config, options.levels + 1) >=
+           MIN_BASE_CELLS_PER_WAVELENGTH) {
+      ++options.levels;
+    }
+  }
+  if (options.levels < 1 || options.margin < 0 || config.steps <= 0) {
+    print_usage();
+    return 1;
+  }
+  if (base_cells_per_wavelength(config, options.levels) < MIN_BASE_CELLS_PER_WAVELENGTH) {
+    std::cerr << "--spf " << config.sim_per_freq << " gives the coarsest of "
+              << options.levels << " grids " << base_cells_per_wavelength(config, options.levels)
+              << " cells per wavelength, it needs " << MIN_BASE_CELLS_PER_WAVELENGTH << "\n";
+    return 1;
+  }
+  config.pulse_steps = config.steps;
+  // The uniform grid of the same size, see RefinedSimulation::fit
+  config = RefinedSimulation::fit(config, options.levels);
+  if (const char *error = config.invalid()) {
+    std::cerr << error << "\n";
+    return 1;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  uint64_t updates = 0;
+  SimResult refined = run_refined(config, options, &updates);
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  const uint64_t uniform_updates =
+      static_cast<uint64_t>(config.width - 2) * (config.height - 2) * config.steps;
+  std::cout << options.levels << " levels on " << config.width << " x " << config.height
+            << " cells, " << config.steps << " steps: " << elapsed.count() << " s, "
+            << updates << " cell updates ("
+            << static_cast<double>(uniform_updates) / updates
+            << "x fewer than uniform)\n";
+
+  std::vector<float> uniform;
+  if (compare) {
+    start = std::chrono::steady_clock::now();
+    uniform = run_simulation(config).lobes;
+    elapsed = std::chrono::steady_clock::now() - start;
+    float peak = 0.0f;
+    float worst = 0.0f;
+    for (size_t i = 0; i < uniform.size(); ++i) {
+      peak = std::max(peak, uniform[i]);
+      worst = std::max(worst, std::fabs(uniform[i] - refined.lobes[i]));
+    }
+    std::cout << "uniform grid: " << elapsed.count() << " s, largest lobe difference "
+              << worst << " (peak " << peak << ")\n";
+  }
+
+  std::ofstream outFile("amr_beam_pattern.txt");
+  if (!outFile.is_open()) {
+    std::cerr << "Unable to open file for writing.\n";
+    return 1;
+  }
+  for (size_t i = 0; i < refined.lobes.size(); ++i) {
+    outFile << i << " " << refined.lobes[i];
+    if (!uniform.empty()) {
+      outFile << " " << uniform[i];
+    }
+    outFile << "\n";
+  }
+  return 0;
+}
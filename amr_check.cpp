@@ -0,0 +1,92 @@
+#include "amr.hpp"
+#include "sonar_sim.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+// Checks RefinedSimulation against the uniform Simulation of the same
+// fitted config, on an 800 cell open-water domain at 40 steps per period
+// (3 levels, as amr_beam picks them), and on the same domain with two
+// reflecting walls and a target that moves far enough to be re-tiled.
+// Prints the cost and the largest lobe difference of each and exits
+// non-zero if a difference exceeds TOLERANCE times the peak lobe, or if a
+// case does fewer than its minimum saving in cell updates.
+//
+//   amr_check [STEPS]
+
+const float TOLERANCE = 0.04f;
+
+struct Case {
+  const char *name;
+  SimConfig config;
+  double min_saving; // uniform cell updates over refined ones
+};
+
+int main(int argc, char *argv[]) {
+  SimConfig open;
+  open.width = 800;
+  open.height = 800;
+  open.sim_per_freq = 40;
+  open.refl_coef = 0.0f;
+  open.steps = argc > 1 ? std::atoi(argv[1]) : 2400;
+  open.pulse_steps = open.steps;
+
+  // A horn of two reflecting walls, with a target crossing it. The walls
+  // are refined along their whole length.
+  SimConfig walls = open;
+  walls.visual_wall = false;
+  walls.wall_angles = {60, -60};
+  TargetSpec target;
+  target.x = open.width / 2 + 60;
+  target.y = open.height - 150;
+  target.vx = -5.0f; // about 24 cells in 2400 steps
+  target.vy = 0.0f;
+  target.rx = 6.0f;
+  target.ry = 3.0f;
+  walls.targets.push_back(target);
+
+  RefinedSimulation::Options options;
+  const Case cases[] = {{"open water", RefinedSimulation::fit(open, options.levels), 20.0},
+                        {"walls and target", RefinedSimulation::fit(walls, options.levels), 10.0}};
+
+  bool failed = false;
+  for (const Case &c : cases) {
+    if (const char *error = c.config.invalid()) {
+      std::cerr << c.name << ": " << error << "\n";
+      return 1;
+    }
+    auto t0 = std::chrono::steady_clock::now();
+    uint64_t updates = 0;
+    const SimResult refined = run_refined(c.config, options, &updates);
+    auto t1 = std::chrono::steady_clock::now();
+    const SimResult uniform = run_simulation(c.config);
+    auto t2 = std::chrono::steady_clock::now();
+
+    float peak = 0.0f;
+    float worst = 0.0f;
+    for (size_t i = 0; i < uniform.lobes.size(); ++i) {
+      peak = std::max(peak, uniform.lobes[i]);
+      worst = std::max(worst, std::fabs(uniform.lobes[i] - refined.lobes[i]));
+    }
+    const double saving = static_cast<double>(c.config.width - 2) * (c.config.height - 2) *
+                          c.config.steps / updates;
+    std::cout << c.name << ": " << c.config.steps << " steps, refined "
+              << std::chrono::duration<double>(t1 - t0).count() << " s, uniform "
+              << std::chrono::duration<double>(t2 - t1).count() << " s, " << saving
+              << "x fewer cell updates, largest lobe difference " << worst << " (peak "
+              << peak << ")\n";
+    if (!(worst <= TOLERANCE * peak)) {
+      std::cerr << c.name << ": refined lobes differ from the uniform grid by more than "
+                << TOLERANCE * 100 << "% of the peak\n";
+      failed = true;
+    }
+    if (saving < c.min_saving) {
+      std::cerr << c.name << ": refined grid saves less than " << c.min_saving << "x\n";
+      failed = true;
+    }
+  }
+  return failed ? 1 : 0;
+}
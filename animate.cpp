@@ -1,15 +1,56 @@
 #include "raylib.h"
+#include "substep_scheduler.hpp"
 #include "waterpool.hpp"
+#include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <cstdio>
 #include <iostream>
 #include <string>
+#include <vector>
 
 const int WIDTH = 250;
 const int HEIGHT = 250;
-using PoolType = Sapphire::WaterPool<WIDTH, HEIGHT>;
+using PoolType = Sapphire::FastWaterPool<WIDTH, HEIGHT>;
 
 const int PIXELS_PER_CELL = 4;
+const int TARGET_FPS = 60;
+const double TARGET_RTF = 1.0;            // simulated seconds per wall second
+const double STEP_BUDGET = 0.7 / TARGET_FPS; // leave the rest for drawing
+const double IMPULSE_RATE = 240.0; // mouse impulses per wall second
+
+// A mouse impulse and the substep of the current frame it belongs to
+struct Impulse {
+  int step;
+  int i;
+  int j;
+};
+
+// Generate the impulses of a held mouse button between wall times t0 and t1.
+// They come at a fixed wall-clock rate, along the path from m0 to m1, and
+// each one is mapped onto the matching substep of the frame.
+void collect_impulses(std::vector<Impulse> &impulses, double &next_impulse,
+                      double t0, double t1, Vector2 m0, Vector2 m1,
+                      int steps) {
+  impulses.clear();
+  if (!IsMouseButtonDown(MOUSE_BUTTON_LEFT)) {
+    next_impulse = t1;
+    return;
+  }
+  next_impulse = std::max(next_impulse, t0);
+  for (; next_impulse <= t1; next_impulse += 1.0 / IMPULSE_RATE) {
+    float f = t1 > t0 ? static_cast<float>((next_impulse - t0) / (t1 - t0)) : 1.0f;
+    float x = m0.x + f * (m1.x - m0.x);
+    float y = m0.y + f * (m1.y - m0.y);
+    int i = static_cast<int>(x) / PIXELS_PER_CELL;
+    int j = static_cast<int>(y) / PIXELS_PER_CELL;
+    if (i < 0 || i >= WIDTH || j < 0 || j >= HEIGHT) {
+      continue;
+    }
+    int step = std::min(static_cast<int>(f * steps), std::max(steps - 1, 0));
+    impulses.push_back(Impulse{step, i, j});
+  }
+}
 
 struct RenderContext {
   const int screenWidth = WIDTH * PIXELS_PER_CELL;
@@ -47,9 +88,9 @@ struct RenderContext {
   void draw(const PoolType &pool) {
     using namespace Sapphire;
 
-    for (int i = 0; i < WIDTH; ++i) {
-      for (int j = 0; j < HEIGHT; ++j) {
-        const WaterCell &cell = pool.getCell(i, j);
+    for (int j = 0; j < HEIGHT; ++j) {
+      for (int i = 0; i < WIDTH; ++i) {
+        const WaterCell cell = pool.getCell(i, j);
         Color color = cellColor(cell);
         DrawRectangle(i * PIXELS_PER_CELL, j * PIXELS_PER_CELL, PIXELS_PER_CELL,
                       PIXELS_PER_CELL, color);
@@ -71,25 +112,61 @@ int main(int argc, const char *argv[]) {
 
   // Create reflective barriers.
   for (int i = 30; i + 10 < WIDTH; ++i) {
-    pool.getCell(i, HEIGHT / 2 - 7).wet = 0.0f;
-    pool.getCell(i - 13, HEIGHT / 2 + 17).wet = 0.0f;
+    pool.setWet(i, HEIGHT / 2 - 7, 0.0f);
+    pool.setWet(i - 13, HEIGHT / 2 + 17, 0.0f);
   }
 
   InitWindow(render.screenWidth, render.screenHeight,
              "Water Simulation by Don Cross");
-  SetTargetFPS(240);
+  SetTargetFPS(TARGET_FPS);
+
+  SubstepScheduler scheduler(dt, TARGET_RTF, STEP_BUDGET);
+  std::vector<Impulse> impulses;
+  double next_impulse = 0.0;
+  double last_time = GetTime();
+  Vector2 last_mouse = GetMousePosition();
+
   while (!WindowShouldClose()) {
-    BeginDrawing();
-    ClearBackground(BLACK);
+    if (IsKeyPressed(KEY_UP)) {
+      scheduler.set_target_rtf(scheduler.target_rtf() * 2.0);
+    }
+    if (IsKeyPressed(KEY_DOWN)) {
+      scheduler.set_target_rtf(scheduler.target_rtf() / 2.0);
+    }
 
+    double now = GetTime();
     Vector2 mouse = GetMousePosition();
-    if (IsMouseButtonDown(MOUSE_BUTTON_LEFT)) {
-      pool.getCell(mouse.x / PIXELS_PER_CELL, mouse.y / PIXELS_PER_CELL).vel =
-          5000.0f;
+    int steps = scheduler.plan(now - last_time);
+    collect_impulses(impulses, next_impulse, last_time, now, last_mouse, mouse,
+                     steps);
+    last_time = now;
+    last_mouse = mouse;
+
+    auto start = std::chrono::steady_clock::now();
+    size_t next = 0;
+    for (int step = 0; step < steps; ++step) {
+      for (; next < impulses.size() && impulses[next].step <= step; ++next) {
+        pool.setVel(impulses[next].i, impulses[next].j, 5000.0f);
+      }
+      pool.update(dt, halflife, k);
     }
+    // No step this frame: the impulses wait in the pool for the next one
+    for (; next < impulses.size(); ++next) {
+      pool.setVel(impulses[next].i, impulses[next].j, 5000.0f);
+    }
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    scheduler.record(steps, elapsed.count());
+
+    BeginDrawing();
+    ClearBackground(BLACK);
     render.draw(pool);
+    DrawText(TextFormat("RTF %.4f / target %.4f%s  (%d steps, %.1f us/step)",
+                        scheduler.achieved_rtf(), scheduler.target_rtf(),
+                        scheduler.degraded() ? "  CPU LIMITED" : "", steps,
+                        scheduler.cost_per_step() * 1e6),
+             10, 10, 20, scheduler.degraded() ? ORANGE : WHITE);
     EndDrawing();
-    pool.update(dt, halflife, k);
   }
   CloseWindow();
   return 0;
@@ -0,0 +1,155 @@
+#include "helmholtz.hpp"
+#include "sonar_sim.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+// Continuous-wave beam pattern from one frequency-domain solve.
+//
+//   cw_beam [--angle DEG] [--freq HZ] [--spf N] [--refl R] [--sponge CELLS]
+//           [--compare STEPS] [--sweep START:STOP:STEP]
+//
+// The boundary is the FDTD refl_coef boundary, so the pattern is the
+// steady state of a CW time-stepped run. --sponge adds an absorbing layer
+// that many cells wide along the sides and top (default 0, off), which
+// changes the boundary physics. One solve costs about as much as 600-1000
+// FDTD steps at any --spf; --sweep reuses the factorization for every
+// element and is where it pays off most.
+// --compare also time steps the same config for STEPS steps and prints
+// both patterns, to check the steady state against the FDTD engine.
+// --sweep solves once per array element instead and writes the pattern of
+// every steering angle in the range to cw_beam_sweep.txt.
+
+// One unit-drive solve per element, then every angle is a weighted sum
+int sweep_angles(const SimConfig &config, const HelmholtzSolver::Options &options,
+                 float start, float stop, float step) {
+  using Complex = HelmholtzSolver::Complex;
+  Simulation sim(config);
+  HelmholtzSolver solver(sim, options);
+  const size_t elements = sim.array_elements().size();
+
+  auto begin = std::chrono::steady_clock::now();
+  std::vector<std::vector<Complex>> element_lobes(elements);
+  for (size_t n = 0; n < elements; ++n) {
+    std::vector<Complex> drive(elements, 0.0);
+    drive[n] = config.amplitude;
+    solver.set_drive(drive);
+    if (!solver.solve()) {
+      std::cerr << "element " << n << " did not converge, residual "
+                << solver.relative_residual() << "\n";
+    }
+    solver.read_lobes(sim, element_lobes[n]);
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+  std::cout << elements << " element solves: " << elapsed.count() << " s\n";
+
+  std::ofstream outFile("cw_beam_sweep.txt");
+  if (!outFile.is_open()) {
+    std::cerr << "Unable to open file for writing.\n";
+    return 1;
+  }
+  outFile << "# angle, then the lobe pressure at 0..179 degrees\n";
+  int angles = 0;
+  for (int i = 0; start + i * step <= stop + step * 1e-3f; ++i, ++angles) {
+    SimConfig steered = config;
+    steered.steer_angle = start + i * step;
+    const double phase = Simulation(steered).element_phase();
+    outFile << steered.steer_angle;
+    for (size_t d = 0; d < element_lobes[0].size(); ++d) {
+      Complex sum = 0.0;
+      for (size_t n = 0; n < elements; ++n) {
+        sum += std::polar(1.0, n * phase) * element_lobes[n][d];
+      }
+      outFile << " " << std::abs(sum);
+    }
+    outFile << "\n";
+  }
+  std::cout << angles << " steering angles written to cw_beam_sweep.txt\n";
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  SimConfig config;
+  HelmholtzSolver::Options options;
+  int compare_steps = 0;
+  float sweep[3] = {0.0f, 0.0f, 0.0f};
+  bool sweeping = false;
+
+  for (int i = 1; i + 1 < argc; i += 2) {
+    const char *arg = argv[i];
+    const char *value = argv[i + 1];
+    if (!std::strcmp(arg, "--angle")) {
+      config.steer_angle = std::atof(value);
+    } else if (!std::strcmp(arg, "--freq")) {
+      config.pulse_freq = std::atof(value);
+    } else if (!std::strcmp(arg, "--spf")) {
+      config.sim_per_freq = std::atoi(value);
+    } else if (!std::strcmp(arg, "--refl")) {
+      config.refl_coef = std::atof(value);
+    } else if (!std::strcmp(arg, "--sponge")) {
+      options.sponge_cells = std::atoi(value);
+    } else if (!std::strcmp(arg, "--compare")) {
+      compare_steps = std::atoi(value);
+    } else if (!std::strcmp(arg, "--sweep")) {
+      sweeping = std::sscanf(value, "%f:%f:%f", &sweep[0], &sweep[1], &sweep[2]) == 3 &&
+                 sweep[2] > 0;
+      if (!sweeping) {
+        std::cerr << "--sweep takes START:STOP:STEP\n";
+        return 1;
+      }
+    } else {
+      std::cerr << "unknown option " << arg << "\n";
+      return 1;
+    }
+  }
+
+  if (const char *error = config.invalid()) {
+    std::cerr << error << "\n";
+    return 1;
+  }
+
+  if (sweeping) {
+    return sweep_angles(config, options, sweep[0], sweep[1], sweep[2]);
+  }
+
+  Simulation sim(config);
+  auto start = std::chrono::steady_clock::now();
+  HelmholtzSolver solver(sim, options);
+  bool converged = solver.solve();
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  std::vector<float> lobes;
+  solver.read_lobes(sim, lobes);
+  std::cout << (converged ? "converged" : "NOT converged") << " after "
+            << solver.iteration_count() << " iterations, residual "
+            << solver.relative_residual() << ", " << elapsed.count() << " s\n";
+
+  std::vector<float> stepped;
+  if (compare_steps > 0) {
+    config.steps = compare_steps;
+    config.pulse_steps = compare_steps;
+    start = std::chrono::steady_clock::now();
+    stepped = run_simulation(config).lobes;
+    elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "time stepping " << compare_steps << " steps: "
+              << elapsed.count() << " s\n";
+  }
+
+  std::ofstream outFile("cw_beam_pattern.txt");
+  if (!outFile.is_open()) {
+    std::cerr << "Unable to open file for writing.\n";
+    return 1;
+  }
+  for (size_t i = 0; i < lobes.size(); ++i) {
+    outFile << i << " " << lobes[i];
+    if (!stepped.empty()) {
+      outFile << " " << stepped[i];
+    }
+    outFile << "\n";
+  }
+  return 0;
+}
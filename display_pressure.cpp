@@ -1,49 +1,210 @@
 #include "raylib.h"
-#include <fstream>
+#include "trace_pyramid.hpp"
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <memory>
+#include <string>
 #include <vector>
 
-const float AMPLITUDE_MULT = 20; // 2*20 = 40, read ampl max ~~ 2
-const int WIDTH = 600;
-const int HEIGHT = 100;
+// Pressure trace viewer. Each file given on the command line is one channel
+// (default output.txt). Files are loaded in the background of the first
+// frames; every frame draws one min/max bar per pixel column from the
+// trace pyramids, so long traces pan and zoom at full frame rate.
+//
+//   mouse wheel / UP DOWN   zoom around the cursor / the centre
+//   left drag / LEFT RIGHT  pan
+//   HOME                    show the whole trace
 
-struct SimRender {
-  const int screenWidth = WIDTH;
-  const int screenHeight = HEIGHT;
+const int WIDTH = 1000;
+const int LANE_HEIGHT = 160;
+const int TARGET_FPS = 60;
+const double LOAD_BUDGET = 0.008;      // wall seconds of parsing per frame
+const size_t LOAD_CHUNK = 256 << 10;   // bytes parsed between budget checks
+const double MIN_SAMPLES_PER_PIXEL = 1.0 / 32; // 32 pixels per sample
+const double ZOOM_STEP = 1.25;         // per mouse wheel notch
+const double ZOOM_SPEED = 15.0;        // how fast the view follows the zoom
+const double PAN_SPEED = 0.75;         // screen widths per second with keys
+const Color CHANNEL_COLORS[] = {DARKBLUE, MAROON, LIME, PURPLE, ORANGE, DARKGRAY};
 
-  void plot_point(float u, float time) {
-    DrawRectangle(WIDTH-time*2, HEIGHT/2-u*AMPLITUDE_MULT, 4, 4, BLACK);
-  }
+struct Channel {
+  std::string name;
+  TracePyramid pyramid;
+  std::unique_ptr<TraceReader> reader;
 };
 
-int main() {
-  SimRender sim_render;
+struct TraceView {
+  double start = 0.0;            // sample index at the left edge
+  double samples_per_pixel = 1.0;
+  double target_spp = 1.0;       // where samples_per_pixel is heading
+  double anchor_x = 0.0;         // screen x that keeps its sample while zooming
+  bool fit = true;               // keep showing everything while loading
+
+  void fit_all(size_t samples) {
+    samples_per_pixel = std::max(double(samples) / WIDTH, MIN_SAMPLES_PER_PIXEL);
+    target_spp = samples_per_pixel;
+    start = 0.0;
+  }
+
+  void zoom(double factor, double x, size_t samples) {
+    double max_spp = std::max(double(samples) / WIDTH, MIN_SAMPLES_PER_PIXEL);
+    target_spp = std::clamp(target_spp * factor, MIN_SAMPLES_PER_PIXEL, max_spp);
+    anchor_x = x;
+    fit = false;
+  }
+
+  void pan(double pixels) {
+    start += pixels * samples_per_pixel;
+    fit = false;
+  }
+
+  // Ease the zoom towards its target, keeping the anchor sample in place
+  void update(double dt, size_t samples) {
+    if (fit) {
+      fit_all(samples);
+      return;
+    }
+    double anchor = start + anchor_x * samples_per_pixel;
+    double f = std::min(1.0, ZOOM_SPEED * dt);
+    samples_per_pixel *= std::pow(target_spp / samples_per_pixel, f);
+    start = anchor - anchor_x * samples_per_pixel;
+    double visible = WIDTH * samples_per_pixel;
+    start = std::clamp(start, 0.0, std::max(0.0, double(samples) - visible));
+  }
+};
 
-  InitWindow(sim_render.screenWidth, sim_render.screenHeight, "Pressure plot"),
-  SetTargetFPS(60);
+int lane_y(float value, float scale, int top) {
+  return top + LANE_HEIGHT / 2 - static_cast<int>(value * scale);
+}
 
-  std::vector<float> numbers;
-  float num;
+void draw_channel(const Channel &channel, const TraceView &view, int lane, Color color) {
+  const TracePyramid &pyramid = channel.pyramid;
+  const int top = lane * LANE_HEIGHT;
+  MinMax extent = pyramid.extent();
+  float amplitude = std::max(std::fabs(extent.lo), std::fabs(extent.hi));
+  float scale = amplitude > 0.0f ? (LANE_HEIGHT / 2 - 12) / amplitude : 1.0f;
 
-  std::ifstream inFile("output.txt");
+  DrawLine(0, top + LANE_HEIGHT / 2, WIDTH, top + LANE_HEIGHT / 2, LIGHTGRAY);
+  DrawLine(0, top + LANE_HEIGHT - 1, WIDTH, top + LANE_HEIGHT - 1, GRAY);
 
-  if (inFile.is_open()) {
-    while (inFile >> num) {
-      numbers.push_back(num); // Read floats from the file and store in vector
+  const double spp = view.samples_per_pixel;
+  if (spp >= 1.0) {
+    // One min/max bar per column
+    for (int x = 0; x < WIDTH; ++x) {
+      size_t begin = static_cast<size_t>(view.start + x * spp);
+      size_t end = static_cast<size_t>(view.start + (x + 1) * spp);
+      MinMax m;
+      if (!pyramid.range(begin, std::max(end, begin + 1), m)) {
+        break;
+      }
+      DrawLine(x, lane_y(m.hi, scale, top), x, lane_y(m.lo, scale, top) + 1, color);
     }
-    inFile.close(); // Close the file
   } else {
-    std::cerr << "Unable to open file for reading.\n";
+    // Fewer samples than pixels: connect the samples, mark them when far apart
+    size_t first = static_cast<size_t>(view.start);
+    size_t last = std::min(pyramid.size(),
+                           static_cast<size_t>(view.start + WIDTH * spp) + 2);
+    int prev_x = 0;
+    int prev_y = 0;
+    for (size_t i = first; i < last; ++i) {
+      int x = static_cast<int>((i - view.start) / spp);
+      int y = lane_y(pyramid.sample(i), scale, top);
+      if (i > first) {
+        DrawLine(prev_x, prev_y, x, y, color);
+      }
+      if (spp < 1.0 / 6) {
+        DrawRectangle(x - 2, y - 2, 5, 5, color);
+      }
+      prev_x = x;
+      prev_y = y;
+    }
+  }
+
+  const char *status = channel.reader->done()
+                           ? TextFormat("%s  %zu samples  [%.3g, %.3g]", channel.name.c_str(),
+                                        pyramid.size(), extent.lo, extent.hi)
+                           : TextFormat("%s  loading %.0f%%  %zu samples", channel.name.c_str(),
+                                        100.0f * channel.reader->progress(), pyramid.size());
+  DrawText(status, 8, top + 6, 10, DARKGRAY);
+}
+
+int main(int argc, char *argv[]) {
+  std::vector<std::string> paths(argv + 1, argv + argc);
+  if (paths.empty()) {
+    paths.push_back("output.txt");
+  }
+  std::vector<std::unique_ptr<Channel>> channels;
+  for (const std::string &path : paths) {
+    auto channel = std::make_unique<Channel>();
+    channel->name = path;
+    channel->reader = std::make_unique<TraceReader>(channel->name);
+    if (!channel->reader->is_open()) {
+      std::cerr << "Unable to open " << channel->name << " for reading.\n";
+      continue;
+    }
+    channels.push_back(std::move(channel));
+  }
+  if (channels.empty()) {
+    return 1;
   }
-  int index = 0;
 
-  ClearBackground(WHITE);
+  const int height = LANE_HEIGHT * static_cast<int>(channels.size()) + 20;
+  InitWindow(WIDTH, height, "Pressure plot");
+  SetTargetFPS(TARGET_FPS);
+
+  TraceView view;
   while (!WindowShouldClose()) {
+    // Parse more of the files, within the frame budget
+    double load_until = GetTime() + LOAD_BUDGET;
+    for (auto &channel : channels) {
+      while (!channel->reader->done() && GetTime() < load_until) {
+        channel->reader->read(channel->pyramid, LOAD_CHUNK);
+      }
+    }
+    size_t samples = 0;
+    for (const auto &channel : channels) {
+      samples = std::max(samples, channel->pyramid.size());
+    }
+
+    float wheel = GetMouseWheelMove();
+    Vector2 mouse = GetMousePosition();
+    if (wheel != 0.0f) {
+      view.zoom(std::pow(ZOOM_STEP, -wheel), mouse.x, samples);
+    }
+    if (IsKeyDown(KEY_UP)) {
+      view.zoom(1.0 / 1.05, WIDTH / 2.0, samples);
+    }
+    if (IsKeyDown(KEY_DOWN)) {
+      view.zoom(1.05, WIDTH / 2.0, samples);
+    }
+    if (IsMouseButtonDown(MOUSE_BUTTON_LEFT)) {
+      Vector2 delta = GetMouseDelta();
+      if (delta.x != 0.0f) {
+        view.pan(-delta.x);
+      }
+    }
+    float dt = GetFrameTime();
+    if (IsKeyDown(KEY_LEFT)) {
+      view.pan(-PAN_SPEED * WIDTH * dt);
+    }
+    if (IsKeyDown(KEY_RIGHT)) {
+      view.pan(PAN_SPEED * WIDTH * dt);
+    }
+    if (IsKeyPressed(KEY_HOME)) {
+      view.fit = true;
+    }
+    view.update(dt, samples);
+
     BeginDrawing();
-    if (index < numbers.size()){
-      sim_render.plot_point(numbers[index], index);
-      index++;
+    ClearBackground(WHITE);
+    for (size_t c = 0; c < channels.size(); ++c) {
+      Color color = CHANNEL_COLORS[c % (sizeof(CHANNEL_COLORS) / sizeof(CHANNEL_COLORS[0]))];
+      draw_channel(*channels[c], view, static_cast<int>(c), color);
     }
+    DrawText(TextFormat("samples %.0f - %.0f   %.3g samples/px   %d fps", view.start,
+                        view.start + WIDTH * view.samples_per_pixel,
+                        view.samples_per_pixel, GetFPS()),
+             8, height - 16, 10, DARKGRAY);
     EndDrawing();
   }
 
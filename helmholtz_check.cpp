@@ -0,0 +1,83 @@
+#include "helmholtz.hpp"
+#include "sonar_sim.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+// Checks the CW solve of HelmholtzSolver against the steady state of the
+// FDTD engine on the default config (refl_coef boundary, no sponge).
+// The time-stepped run drives the array like run_simulation and, over its
+// last PERIODS periods, takes the pulse_freq Fourier amplitude at every
+// lobe point. That is the quantity the CW solve gives; the peak-sampled
+// lobes of run_simulation only see sim_per_freq instants a period and
+// jitter by a few percent with the float time. Prints both timings and
+// exits non-zero if the largest lobe difference exceeds TOLERANCE times
+// the peak lobe.
+//
+//   helmholtz_check [STEPS]
+
+const int PERIODS = 50;
+const float TOLERANCE = 0.02f;
+
+int main(int argc, char *argv[]) {
+  SimConfig config;
+  config.steps = argc > 1 ? std::atoi(argv[1]) : 4000;
+  config.pulse_steps = config.steps;
+  if (const char *error = config.invalid()) {
+    std::cerr << error << "\n";
+    return 1;
+  }
+  const int window = PERIODS * config.sim_per_freq;
+  if (config.steps < 2 * window) {
+    std::cerr << "STEPS must be at least " << 2 * window << "\n";
+    return 1;
+  }
+
+  auto t0 = std::chrono::steady_clock::now();
+  Simulation sim(config);
+  HelmholtzSolver solver(sim);
+  const bool converged = solver.solve();
+  auto t1 = std::chrono::steady_clock::now();
+  std::vector<float> cw;
+  solver.read_lobes(sim, cw);
+
+  // Same sequence as run_simulation
+  std::vector<std::complex<double>> harmonic(180, 0.0);
+  std::vector<float> pressure(180);
+  float time = 0.0f;
+  for (int n = 0; n < config.steps; ++n) {
+    time += sim.time_step();
+    sim.apply_pulse(time);
+    if (n >= config.steps - window) {
+      sim.read_lobes(pressure);
+      const std::complex<double> turn =
+          std::polar(1.0, -2.0 * M_PI * n / config.sim_per_freq);
+      for (int i = 0; i < 180; ++i) {
+        harmonic[i] += double(pressure[i]) * turn;
+      }
+    }
+    sim.step();
+  }
+  auto t2 = std::chrono::steady_clock::now();
+
+  float worst = 0.0f;
+  float peak = 0.0f;
+  for (int i = 0; i < 180; ++i) {
+    const float stepped = static_cast<float>(2.0 * std::abs(harmonic[i]) / window);
+    peak = std::max(peak, stepped);
+    worst = std::max(worst, std::fabs(cw[i] - stepped));
+  }
+  std::cout << "CW solve " << std::chrono::duration<double>(t1 - t0).count() << " s ("
+            << solver.iteration_count() << " iterations), FDTD " << config.steps
+            << " steps " << std::chrono::duration<double>(t2 - t1).count() << " s\n"
+            << "largest lobe difference " << worst << " (peak " << peak << ")\n";
+  if (!converged || !(worst <= TOLERANCE * peak)) {
+    std::cerr << "CW pattern does not match the FDTD steady state\n";
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,300 @@
+/*
+    lbm.hpp
+
+    D2Q9 lattice-Boltzmann solver (BGK collision), intended as a second
+    engine next to the FDTD pressure grid in main.cpp for cases that need a
+    background flow as well as acoustics.
+
+    Storage is structure-of-arrays: one float array per direction.
+    Only ONE copy of the distributions is kept. Streaming is done in place
+    with the AA pattern, alternating two kinds of step:
+
+    even step - read the 9 populations of a cell, collide, and write them
+                back into the same cell in the opposite slots;
+    odd step  - gather the populations arriving from the neighbours (they
+                sit in the opposite slots), collide, and scatter the results
+                straight into the neighbours' natural slots.
+
+    After an odd step the lattice is back in natural layout. Every memory
+    location is read and written by exactly one cell per step, so rows can
+    be processed in parallel without a second buffer. Halfway bounce-back on
+    solid cells falls out of the same scheme: a population that would leave
+    into (or arrive from) a solid cell is kept in the cell itself.
+
+    The domain is periodic in x and y (as the np.roll prototype was); put
+    solid cells on the border for closed walls.
+*/
+#ifndef __SONAR_LBM_HPP
+#define __SONAR_LBM_HPP
+
+#include "worker_pool.hpp"
+#include <cmath>
+#include <vector>
+
+class LatticeBoltzmann {
+public:
+  static const int Q = 9;
+  // Direction order matches the old prototype in test.cpp
+  static constexpr int CX[Q] = {0, 0, 1, 1, 1, 0, -1, -1, -1};
+  static constexpr int CY[Q] = {0, 1, 1, 0, -1, -1, -1, 0, 1};
+  static constexpr int OPP[Q] = {0, 5, 6, 7, 8, 1, 2, 3, 4};
+  static constexpr float W[Q] = {4.0f / 9,  1.0f / 9,  1.0f / 36,
+                                 1.0f / 9,  1.0f / 36, 1.0f / 9,
+                                 1.0f / 36, 1.0f / 9,  1.0f / 36};
+  static constexpr float CS2 = 1.0f / 3.0f; // lattice speed of sound squared
+
+  // tau - BGK relaxation time, viscosity = CS2 * (tau - 0.5)
+  LatticeBoltzmann(int nx, int ny, float tau, unsigned threads = 0)
+      : nx(nx), ny(ny), omega(1.0f / tau), kind(nx * ny, FLUID),
+        workers(WorkerPool::threads_for(static_cast<long>(nx) * ny, threads)) {
+    for (int q = 0; q < Q; ++q) {
+      f[q].assign(nx * ny, 0.0f);
+    }
+    initialise(1.0f, 0.0f, 0.0f);
+  }
+
+  int width() const { return nx; }
+  int height() const { return ny; }
+  long steps() const { return time; }
+
+  void set_solid(int x, int y, bool value) {
+    kind[index(x, y)] = value ? SOLID : FLUID;
+  }
+  bool is_solid(int x, int y) const { return kind[index(x, y)] == SOLID; }
+
+  // Acoustic point source: instead of relaxing, the cell is set to the
+  // equilibrium at the driven density and its own velocity on every
+  // collision. Returns the id for set_source.
+  int add_source(int x, int y) {
+    kind[index(x, y)] = SOURCE;
+    sources.push_back(Source{index(x, y), 1.0f});
+    return static_cast<int>(sources.size()) - 1;
+  }
+  void set_source(int id, float rho) { sources[id].rho = rho; }
+
+  // Fill every cell with the equilibrium for the given density and velocity
+  void initialise(float rho, float ux, float uy) {
+    float feq[Q];
+    equilibrium(rho, ux, uy, feq);
+    for (int q = 0; q < Q; ++q) {
+      std::fill(f[q].begin(), f[q].end(), feq[q]);
+    }
+    time = 0;
+  }
+
+  void step() {
+    const bool odd = (time & 1) != 0;
+    workers.parallel_for(ny, [&](int y0, int y1) {
+      for (int y = y0; y < y1; ++y) {
+        if (odd) {
+          update_row<true>(y);
+        } else {
+          update_row<false>(y);
+        }
+      }
+    });
+    for (const Source &source : sources) {
+      force_source(source, odd);
+    }
+    ++time;
+  }
+
+  // The accessors see the streamed state at the current time level. After
+  // an odd step that is the cell's own slots; after an even step the cell
+  // only holds its own collision outputs, so the populations arriving at
+  // it are gathered from the neighbours the way odd_cell does.
+  float density(int x, int y) const {
+    float fq[Q];
+    populations(x, y, fq);
+    float rho = 0.0f;
+    for (int q = 0; q < Q; ++q) {
+      rho += fq[q];
+    }
+    return rho;
+  }
+
+  // Acoustic pressure relative to the reference density rho0
+  float pressure(int x, int y, float rho0 = 1.0f) const {
+    return CS2 * (density(x, y) - rho0);
+  }
+
+  void velocity(int x, int y, float &ux, float &uy) const {
+    float fq[Q];
+    populations(x, y, fq);
+    float rho = 0.0f;
+    ux = 0.0f;
+    uy = 0.0f;
+    for (int q = 0; q < Q; ++q) {
+      rho += fq[q];
+      ux += CX[q] * fq[q];
+      uy += CY[q] * fq[q];
+    }
+    ux /= rho;
+    uy /= rho;
+  }
+
+private:
+  enum : unsigned char { FLUID, SOLID, SOURCE };
+
+  struct Source {
+    int cell;
+    float rho;
+  };
+
+  int nx;
+  int ny;
+  float omega;
+  long time = 0;
+  std::vector<float> f[Q];
+  std::vector<unsigned char> kind;
+  std::vector<Source> sources;
+  WorkerPool workers;
+
+  int index(int x, int y) const { return y * nx + x; }
+
+  static void equilibrium(float rho, float ux, float uy, float *feq) {
+    const float usq = 1.5f * (ux * ux + uy * uy);
+    for (int q = 0; q < Q; ++q) {
+      const float cu = 3.0f * (CX[q] * ux + CY[q] * uy);
+      feq[q] = W[q] * rho * (1.0f + cu + 0.5f * cu * cu - usq);
+    }
+  }
+
+  // BGK collision of one cell from fq into out
+  void collide(const float *fq, float *out) const {
+    float rho = 0.0f;
+    float ux = 0.0f;
+    float uy = 0.0f;
+    for (int q = 0; q < Q; ++q) {
+      rho += fq[q];
+      ux += CX[q] * fq[q];
+      uy += CY[q] * fq[q];
+    }
+    ux /= rho;
+    uy /= rho;
+    float feq[Q];
+    equilibrium(rho, ux, uy, feq);
+    for (int q = 0; q < Q; ++q) {
+      out[q] = fq[q] + omega * (feq[q] - fq[q]);
+    }
+  }
+
+  // Populations of cell x, y in natural order, streamed to the current time
+  void populations(int x, int y, float *fq) const {
+    const int c = index(x, y);
+    if ((time & 1) == 0 || kind[c] == SOLID) {
+      for (int q = 0; q < Q; ++q) {
+        fq[q] = f[q][c];
+      }
+      return;
+    }
+    // The population moving along q comes from c - e_q, where the even step
+    // left it in the opposite slot, or bounced back from a solid neighbour
+    for (int q = 0; q < Q; ++q) {
+      const int from = index((x - CX[q] + nx) % nx, (y - CY[q] + ny) % ny);
+      fq[q] = (kind[from] == SOLID) ? f[q][c] : f[OPP[q]][from];
+    }
+  }
+
+  // Where the collision output of cell c along q was stored by the last
+  // even (local) or odd (scattered) step
+  float &output_slot(int c, int q, bool odd) {
+    if (!odd) {
+      return f[OPP[q]][c];
+    }
+    const int x = c % nx;
+    const int y = c / nx;
+    const int to = index((x + CX[q] + nx) % nx, (y + CY[q] + ny) % ny);
+    return kind[to] == SOLID ? f[OPP[q]][c] : f[q][to];
+  }
+
+  // A source cell went through the sweep as ordinary fluid. Its outputs are
+  // only ever written by the cell itself, so they can be replaced here with
+  // the equilibrium at the driven density. BGK keeps the momentum, so the
+  // velocity read back from the outputs is the one the cell collided with.
+  void force_source(const Source &source, bool odd) {
+    float rho = 0.0f;
+    float ux = 0.0f;
+    float uy = 0.0f;
+    for (int q = 0; q < Q; ++q) {
+      const float v = output_slot(source.cell, q, odd);
+      rho += v;
+      ux += CX[q] * v;
+      uy += CY[q] * v;
+    }
+    float feq[Q];
+    equilibrium(source.rho, ux / rho, uy / rho, feq);
+    for (int q = 0; q < Q; ++q) {
+      output_slot(source.cell, q, odd) = feq[q];
+    }
+  }
+
+  template <bool ODD> void update_row(int y) {
+    const int ym = (y == 0) ? ny - 1 : y - 1;
+    const int yp = (y == ny - 1) ? 0 : y + 1;
+    const int rows[3] = {ym * nx, y * nx, yp * nx};
+    const unsigned char *k = kind.data();
+    float *fp[Q];
+    for (int q = 0; q < Q; ++q) {
+      fp[q] = f[q].data();
+    }
+
+    if (!ODD) {
+      // Purely local, so written without branches for the vectorizer:
+      // solid cells collide too but keep their old values
+#pragma GCC ivdep
+      for (int c = y * nx; c < (y + 1) * nx; ++c) {
+        float fq[Q];
+        for (int q = 0; q < Q; ++q) {
+          fq[q] = fp[q][c];
+        }
+        float out[Q];
+        collide(fq, out);
+        for (int q = 0; q < Q; ++q) {
+          fp[OPP[q]][c] = (k[c] == SOLID) ? fq[OPP[q]] : out[q];
+        }
+      }
+      return;
+    }
+
+    // Only the two edge columns wrap around. The bounce-back scatter is a
+    // conditional store into one of two arrays, so unlike the even step
+    // this loop stays scalar.
+    odd_cell(0, (nx == 1) ? 0 : nx - 1, (nx == 1) ? 0 : 1, rows, fp, k);
+    for (int x = 1; x < nx - 1; ++x) {
+      odd_cell(x, x - 1, x + 1, rows, fp, k);
+    }
+    if (nx > 1) {
+      odd_cell(nx - 1, nx - 2, 0, rows, fp, k);
+    }
+  }
+
+  // Odd step for one fluid cell: gather from the neighbours, collide, scatter
+  inline void odd_cell(int x, int xm, int xp, const int *rows,
+                       float *const *fp, const unsigned char *k) const {
+    const int c = rows[1] + x;
+    if (k[c] == SOLID) {
+      return;
+    }
+    const int cols[3] = {xm, x, xp};
+    float fq[Q];
+    float out[Q];
+    // The population moving along q comes from c - e_q
+    for (int q = 0; q < Q; ++q) {
+      const int from = rows[1 - CY[q]] + cols[1 - CX[q]];
+      fq[q] = (k[from] == SOLID) ? fp[q][c] : fp[OPP[q]][from];
+    }
+    collide(fq, out);
+    // Scatter to c + e_q, or bounce back into c
+    for (int q = 0; q < Q; ++q) {
+      const int to = rows[1 + CY[q]] + cols[1 + CX[q]];
+      if (k[to] == SOLID) {
+        fp[OPP[q]][c] = out[q];
+      } else {
+        fp[q][to] = out[q];
+      }
+    }
+  }
+};
+
+#endif // __SONAR_LBM_HPP
@@ -1,144 +1,53 @@
 #include "raylib.h"
+#include "sonar_sim.hpp"
+#include "spectral.hpp"
+#include "telemetry.hpp"
 #include <algorithm>
 #include <cmath>
 #include <iostream>
+#include <limits>
 #include <utility>
 #include <vector>
 #include <fstream>
 // 0.0010025
 
-const float PI_F = 3.14159265358979f;
-
-const float REFL_COEF = 0.7; // Reflection coeficient
-// Gamma - used for absorbing walls
-const float G = (1 - REFL_COEF) / (1 + REFL_COEF);
-const float LF = 0.5 * sqrt(0.5) * G; // Loss factor
-const float C = 343; // Speed of sound constant
-const float PULSE_FREQ = 40000.0f; // Frequency in Hz (for example, 440Hz = A4 note)
-const int SIM_PER_FREQ = 10; // number of simulations that will get run per frequency
-const float AMPLITUDE = 2.0f;    // Amplitude of the pulse
 const int FPS = 120; // Actual FPS
-const int SIM_RATE = PULSE_FREQ * SIM_PER_FREQ; // Used to get the simulation time step (dt) 
-const float DT = 1.0 / SIM_RATE;
-// const float DX = C * DT * 1.01; // calculate the minimum and add 1% just in case
-const float DX = (C * DT)/(sqrt(0.5)); // calculate the minimum and add 1% just in case
-                                // // dt <= dx/C | dx >= C*dt ~~ 2.86
-// Currently wave length ~~ 8.575mm
-// 1 pixel == wave_length/4
-const float WAVE_LENGTH = C/PULSE_FREQ;
-const float PIXEL_SCALE = PULSE_FREQ/4;
-const int WIDTH = 200; // Model assumes 100x100 represents 1m x 1m area irl
-const int HEIGHT = 200;
 const int PIXELS_PER_CELL = 5;
-const bool VISUAL_WALL = true;
-
-std::vector<float> pressures;
-
-struct Cell {
-  float u;
-  bool wall;
-
-  Cell() : u(0.0), wall(false) {}
-};
-
-std::vector<std::vector<Cell>> grid(HEIGHT, std::vector<Cell>(WIDTH));
-std::vector<std::vector<Cell>> prev_grid;
-std::vector<std::vector<Cell>> next_grid;
-
-/*
-std::vector<std::pair<int, int>> wall_line_list = {
-  {static_cast<int>(WIDTH / 2 - 7), static_cast<int>(HEIGHT - 20)},
-  {static_cast<int>(WIDTH / 2 - 5), static_cast<int>(HEIGHT - 10)},
-  {static_cast<int>(WIDTH / 2 - 5), static_cast<int>(HEIGHT + 0)},
-  {static_cast<int>(WIDTH / 2 + 5), static_cast<int>(HEIGHT + 0)},
-  {static_cast<int>(WIDTH / 2 + 5), static_cast<int>(HEIGHT - 10)},
-  {static_cast<int>(WIDTH / 2 + 7), static_cast<int>(HEIGHT - 20)},
-};
-*/
-
-float deg2rad(float angle) {
-  return angle * (PI_F / 180.0);
-}
-
-// TODO use raylib builtin DrawLine to draw walls instead of calculating each point
-std::vector<std::pair<int, int>> wall_line_list = {
-  {static_cast<int>(WIDTH / 2), static_cast<int>(HEIGHT - 0)},
-  {static_cast<int>(WIDTH / 2 + WIDTH*std::cos(deg2rad(90-30))), static_cast<int>(HEIGHT - WIDTH*std::sin(deg2rad(90-30)))},
-  {static_cast<int>(WIDTH / 2), static_cast<int>(HEIGHT - 0)},
-  {static_cast<int>(WIDTH / 2 + WIDTH*std::cos(deg2rad(90-45))), static_cast<int>(HEIGHT - WIDTH*std::sin(deg2rad(90-45)))},
-  {static_cast<int>(WIDTH / 2), static_cast<int>(HEIGHT - 0)},
-  {static_cast<int>(WIDTH / 2 + WIDTH*std::cos(deg2rad(90-60))), static_cast<int>(HEIGHT - WIDTH*std::sin(deg2rad(90-60)))},
-  {static_cast<int>(WIDTH / 2), static_cast<int>(HEIGHT - 0)},
-  {static_cast<int>(WIDTH / 2 + WIDTH*std::cos(deg2rad(90))), static_cast<int>(HEIGHT - WIDTH*std::sin(deg2rad(90)))},
-  {static_cast<int>(WIDTH / 2), static_cast<int>(HEIGHT - 0)},
-  {static_cast<int>(WIDTH / 2 + WIDTH*std::cos(deg2rad(90+60))), static_cast<int>(HEIGHT - WIDTH*std::sin(deg2rad(90+60)))},
-  {static_cast<int>(WIDTH / 2), static_cast<int>(HEIGHT - 0)},
-  {static_cast<int>(WIDTH / 2 + WIDTH*std::cos(deg2rad(90+45))), static_cast<int>(HEIGHT - WIDTH*std::sin(deg2rad(90+45)))},
-  {static_cast<int>(WIDTH / 2), static_cast<int>(HEIGHT - 0)},
-  {static_cast<int>(WIDTH / 2 + WIDTH*std::cos(deg2rad(90+30))), static_cast<int>(HEIGHT - WIDTH*std::sin(deg2rad(90+30)))},
-};
-
-void apply_pulse(float time, float angle) {
-  // WORKS UP TO 45 degrees
-  angle = 30;
-  int antena_spacing = 2; // half a wavelength in pixels
-  //
-  float radian = deg2rad(angle);
-  //float phase_shift = (PI_F * std::sin(radian))/2;
-  float phase_shift = (2 * PI_F * (WAVE_LENGTH/2) * std::sin(radian))/WAVE_LENGTH/2;
-  if (angle > 90) {
-    phase_shift *= -1;
-  }
-
-  // Apply cumulative phase shifts to pulses
-  float pulse1 = AMPLITUDE * std::sin(2 * PI_F * PULSE_FREQ * time + phase_shift * 0);
-  float pulse2 = AMPLITUDE * std::sin(2 * PI_F * PULSE_FREQ * time + phase_shift * 1);
-  float pulse3 = AMPLITUDE * std::sin(2 * PI_F * PULSE_FREQ * time + phase_shift * 2);
-  float pulse4 = AMPLITUDE * std::sin(2 * PI_F * PULSE_FREQ * time + phase_shift * 3);
-  float pulse5 = AMPLITUDE * std::sin(2 * PI_F * PULSE_FREQ * time + phase_shift * 4);
-  float pulse6 = AMPLITUDE * std::sin(2 * PI_F * PULSE_FREQ * time + phase_shift * 5);
-  float pulse7 = AMPLITUDE * std::sin(2 * PI_F * PULSE_FREQ * time + phase_shift * 6);
-
-  // Assign pulses to grid positions
-  grid[static_cast<int>(HEIGHT - 2)][static_cast<int>(WIDTH / 2 - antena_spacing * 3)].u = pulse1;
-  grid[static_cast<int>(HEIGHT - 2)][static_cast<int>(WIDTH / 2 - antena_spacing * 2)].u = pulse2;
-  grid[static_cast<int>(HEIGHT - 2)][static_cast<int>(WIDTH / 2 - antena_spacing * 1)].u = pulse3;
-  grid[static_cast<int>(HEIGHT - 2)][static_cast<int>(WIDTH / 2 + antena_spacing * 0)].u = pulse4;
-  grid[static_cast<int>(HEIGHT - 2)][static_cast<int>(WIDTH / 2 + antena_spacing * 1)].u = pulse5;
-  grid[static_cast<int>(HEIGHT - 2)][static_cast<int>(WIDTH / 2 + antena_spacing * 2)].u = pulse6;
-  grid[static_cast<int>(HEIGHT - 2)][static_cast<int>(WIDTH / 2 + antena_spacing * 3)].u = pulse7;
-}
-
-float read_pressure(int x, int y) {
-  float pressure = grid[y][x].u;
-  return pressure;
+// Frequency bins tracked at every lobe point for per-frequency beam patterns
+const int SPECTRAL_BINS = 9;
+const float SPECTRAL_LOW = 20000.0f;
+const float SPECTRAL_HIGH = 60000.0f;
+// Live telemetry for external viewers, see telemetry_tail.cpp
+const char *TELEMETRY_NAME = "/sonar_telemetry";
+const int PROBE_BATCH = 64;    // probe samples per record
+const int FIELD_EVERY = 4;     // steps between field frames
+const int FIELD_DOWNSAMPLE = 4; // field frames average 4x4 cells
+
+// Every simulation parameter lives in SimConfig (sonar_sim.hpp). Change the
+// defaults there or override them here, e.g. for broadband pings:
+//   config.wave_kind = Waveform::CHIRP;
+SimConfig make_config() {
+  SimConfig config;
+  config.targets = {
+    // Submarine hull crossing the beam at ~10 m/s
+    {30, config.height / 2.0f, 10.0f, 0.0f, 12, 3},
+    // Small fish school drifting towards the array
+    {config.width * 0.7f, config.height / 4.0f, -1.5f, 2.0f, 2, 2},
+    {config.width * 0.7f + 6, config.height / 4.0f + 4, -1.5f, 2.0f, 2, 2},
+    {config.width * 0.7f - 5, config.height / 4.0f + 7, -1.5f, 2.0f, 2, 2},
+  };
+  return config;
 }
 
-void read_lobes(std::vector<float> &lobes_pressure) {
-  // Read 180 points, for 180 degrees
-  // with r radius around the center bottom (pulse source)
-  int r = 50;
-  for (int i = 0; i < 180; ++i) {
-    int x = WIDTH/2 - static_cast<int>(r*std::cos(deg2rad(i)));
-    int y = HEIGHT-2 - static_cast<int>(r*std::sin(deg2rad(i)));
-
-    float val = read_pressure(x, y);
-    lobes_pressure[i] = val;
-  }
-}
-
-void compare_lobes_pressures(std::vector<float> &lobes_pressure1, std::vector<float> &lobes_pressure2) {
-  if (lobes_pressure1.size() != lobes_pressure2.size()) {
-    std::cout << "lobe pressure lists should be the same length" << std::endl;
-  }
-  for (int i = 0; i < lobes_pressure1.size(); ++i) {
-    lobes_pressure1[i] = std::max(std::fabs(lobes_pressure1[i]), std::fabs(lobes_pressure2[i]));
-  }
-}
+std::vector<float> pressures;
 
 struct SimRender {
-  const int screenWidth = WIDTH * PIXELS_PER_CELL;
-  const int screenHeight = HEIGHT * PIXELS_PER_CELL;
+  const int screenWidth;
+  const int screenHeight;
+
+  SimRender(int width, int height)
+      : screenWidth(width * PIXELS_PER_CELL),
+        screenHeight(height * PIXELS_PER_CELL) {}
 
   void draw_cell(int x, int y, Color color) {
     DrawRectangle(x * PIXELS_PER_CELL, y * PIXELS_PER_CELL,
@@ -156,28 +65,16 @@ struct SimRender {
   }
 };
 
-float calculate_pressure(int x, int y, int k, float dt) {
-  float val =
-    (1 / (1 + LF * (4 - k))) * ((2 - 0.5 * k) * grid[y][x].u +
-    0.5 * (grid[y][x + 1].u + grid[y][x - 1].u +
-    grid[y + 1][x].u + grid[y - 1][x].u) +
-    (LF * (4 - k) - 1) * prev_grid[y][x].u);
-
-  return val;
-}
-
-void find_min_max_2D_cell(float &min_val, float &max_val, const std::vector<std::vector<Cell>> grid) {
+void find_min_max_2D_cell(float &min_val, float &max_val, const std::vector<float> &field) {
   min_val = std::numeric_limits<float>::max();
   max_val = std::numeric_limits<float>::min();
 
-  for (const auto &row : grid) {
-    for (const auto &cell : row) {
-      if (cell.u < min_val) {
-        min_val = cell.u;
-      }
-      if (cell.u > max_val) {
-        max_val = cell.u;
-      }
+  for (const float u : field) {
+    if (u < min_val) {
+      min_val = u;
+    }
+    if (u > max_val) {
+      max_val = u;
     }
   }
 }
@@ -209,7 +106,26 @@ int cos_interp(int a, int b, float t) {
   return static_cast<int>(a + f * (b - a));
 }
 
-Color get_color(Cell cell, float max_val) {
+// Publish the pressure field averaged over FIELD_DOWNSAMPLE^2 blocks
+void publish_field(TelemetryWriter &telemetry, const Simulation &sim,
+                   uint64_t step, float time, std::vector<float> &frame) {
+  const int w = sim.width / FIELD_DOWNSAMPLE;
+  const int h = sim.height / FIELD_DOWNSAMPLE;
+  frame.assign(w * h, 0.0f);
+  const float scale = 1.0f / (FIELD_DOWNSAMPLE * FIELD_DOWNSAMPLE);
+  for (int y = 0; y < h * FIELD_DOWNSAMPLE; ++y) {
+    for (int x = 0; x < w * FIELD_DOWNSAMPLE; ++x) {
+      frame[(y / FIELD_DOWNSAMPLE) * w + x / FIELD_DOWNSAMPLE] +=
+          scale * sim.read_pressure(x, y);
+    }
+  }
+  TelemetryRecord record{TELEMETRY_FIELD, static_cast<uint32_t>(frame.size()),
+                         static_cast<uint32_t>(w), static_cast<uint32_t>(h),
+                         step, time};
+  telemetry.publish(record, frame.data());
+}
+
+Color get_color(float u, const Cell &cell, float max_val) {
   Color color;
   if (cell.wall) {
     color.r = 255; // Red
@@ -217,7 +133,7 @@ Color get_color(Cell cell, float max_val) {
     color.b = 255; // Blue
     color.a = 255; // Alpha (fully opaque)
   } else {
-    float cval = cell.u;
+    float cval = u;
     cval = (cval - (-max_val)) / (max_val - (-max_val));
     cval = std::clamp(cval, 0.0f, 1.0f);
 
@@ -232,118 +148,57 @@ Color get_color(Cell cell, float max_val) {
   return color;
 }
 
-std::vector<std::pair<int, int>> bresenham_line(int x0, int y0, int x1,
-                                                int y1) {
-  std::vector<std::pair<int, int>> points;
-  int dx = abs(x1 - x0);
-  int dy = abs(y1 - y0);
-  int sx = (x0 < x1) ? 1 : -1;
-  int sy = (y0 < y1) ? 1 : -1;
-  int err = dx - dy;
-
-  while (true) {
-    points.push_back(
-        std::make_pair(x0, y0)); // Add the current point to the list
-    if (x0 == x1 && y0 == y1) {  // If we've reached the end point, stop
-      break;
-    }
-    int e2 = 2 * err;
-    if (e2 > -dy) {
-      err -= dy;
-      x0 += sx;
-    }
-    if (e2 < dx) {
-      err += dx;
-      y0 += sy;
-    }
-  }
-
-  return points;
-}
-
-void set_wall_cells(std::vector<std::vector<Cell>> &grid,
-                    const std::vector<std::pair<int, int>> &wall_line_list) {
-  for (size_t i = 0; i < wall_line_list.size() - 1; ++i) {
-    int x0 = wall_line_list[i].first;
-    int y0 = wall_line_list[i].second;
-    int x1 = wall_line_list[i + 1].first;
-    int y1 = wall_line_list[i + 1].second;
-
-    // Generate all points between these two coordinates
-    std::vector<std::pair<int, int>> line_points =
-        bresenham_line(x0, y0, x1, y1);
-
-    // Set the corresponding cells in the grid as walls
-    for (const auto &point : line_points) {
-      int x = point.first;
-      int y = point.second;
-
-      // Check if coordinates are within grid bounds
-      if (x >= 0 && x < grid[0].size() && y >= 0 && y < grid.size()) {
-        grid[y][x].wall = true;
-      }
-    }
-  }
-}
-
 int main() {
-  SimRender sim_render;
+  Simulation sim(make_config());
+  const SimConfig &config = sim.config;
+  const int WIDTH = sim.width;
+  const int HEIGHT = sim.height;
+  SimRender sim_render(WIDTH, HEIGHT);
 
   InitWindow(sim_render.screenWidth, sim_render.screenHeight, "Sonar simulation");
   SetTargetFPS(FPS);
 
-  set_wall_cells(grid, wall_line_list); // Only visual no effect on wave rn
-  prev_grid = grid;
-  next_grid = grid;
-
   // assign_initial_state();
   float time = 0.0;
   int sample_index = 0;
   std::vector<float> lobes_pressure_store(180, 0.0);
   std::vector<float> lobes_pressure_read(180, 0.0);
+  SpectralProbes lobe_spectra(
+      180, SpectralProbes::linear_bins(SPECTRAL_LOW, SPECTRAL_HIGH, SPECTRAL_BINS),
+      config.sim_rate());
 
   float pulse_time = 1.0; // send a pules for 2 seconds and stop
   float pulse_time_current = 0.0;
 
+  // The field frame is the largest record; lobes (180) and probe batches
+  // fit in the default slot
+  const uint32_t field_floats =
+      (WIDTH / FIELD_DOWNSAMPLE) * (HEIGHT / FIELD_DOWNSAMPLE);
+  TelemetryWriter telemetry(TELEMETRY_NAME, TelemetryWriter::DEFAULT_SLOTS,
+                            field_floats > TelemetryWriter::DEFAULT_FLOATS
+                                ? field_floats
+                                : TelemetryWriter::DEFAULT_FLOATS);
+  if (!telemetry.is_open()) {
+    std::cerr << "Telemetry disabled: unable to create " << TELEMETRY_NAME << "\n";
+  }
+  uint64_t step = 0;
+  std::vector<float> probe_batch;
+  std::vector<float> field_frame;
+
   while (!WindowShouldClose()) {
-    time += DT;
+    time += sim.time_step();
     pulse_time_current += GetFrameTime();
     if (pulse_time_current < pulse_time) {
-      apply_pulse(time, PI_F/3);
-    }
-
-    for (int y = 1; y < HEIGHT - 1; ++y) {
-      for (int x = 1; x < WIDTH - 1; ++x) {
-        int k = 4;
-        if (y == 1 || y == HEIGHT - 2) {
-          k -= 1;
-        }
-        if (x == 1 || x == WIDTH - 2) {
-          k -= 1;
-        }
-
-        std::vector<std::pair<int, int>> neighbours_list = {
-            {x + 1, y}, {x - 1, y}, {x, y + 1}, {x, y - 1}};
-        for (const std::pair<int, int> neighbour_cell : neighbours_list) {
-          if (grid[neighbour_cell.second][neighbour_cell.first].wall) {
-            if (!VISUAL_WALL) {
-              k -= 1;
-            }
-          }
-        }
-        if (!grid[y][x].wall || VISUAL_WALL) {
-          float val = calculate_pressure(x, y, k, DT);
-          next_grid[y][x].u = val;
-        }
-      }
+      sim.apply_pulse(time);
     }
 
     float min_val;
     float max_val;
-    find_min_max_2D_cell(min_val, max_val, grid);
-    max_val = AMPLITUDE; // Temp override for testing
+    find_min_max_2D_cell(min_val, max_val, sim.field());
+    max_val = config.amplitude; // Temp override for testing
 
-    read_lobes(lobes_pressure_read);
+    sim.read_lobes(lobes_pressure_read);
+    lobe_spectra.add_samples(lobes_pressure_read.data());
     sample_index++;
     compare_lobes_pressures(lobes_pressure_store, lobes_pressure_read);
 
@@ -353,10 +208,14 @@ int main() {
 
     for (int y = 0; y < HEIGHT; ++y) {
       for (int x = 0; x < WIDTH; ++x) {
-        Color color = get_color(grid[y][x], max_val);
-        if (grid[y][x].wall) {
+        const Cell &cell = sim.cell(x, y);
+        Color color = get_color(sim.read_pressure(x, y), cell, max_val);
+        if (cell.wall) {
           color = WHITE;
         }
+        if (cell.targets > 0) {
+          color = ORANGE;
+        }
         sim_render.draw_cell(x, y, color);
       }
     }
@@ -370,15 +229,31 @@ int main() {
       sim_render.draw_line(x*30, 0, x*30, HEIGHT, RED);
     }
 
-    if (sample_index == SIM_PER_FREQ) {
+    if (sample_index == config.sim_per_freq) {
+      // The finished period's pattern, as drawn above
+      TelemetryRecord lobes{TELEMETRY_LOBES,
+                            static_cast<uint32_t>(lobes_pressure_store.size()),
+                            0, 0, step, time};
+      telemetry.publish(lobes, lobes_pressure_store.data());
       sample_index = 0;
       std::fill(lobes_pressure_store.begin(), lobes_pressure_store.end(), 0.0);
     }
 
-    pressures.push_back(read_pressure(50, 1));
+    pressures.push_back(sim.read_pressure(config.probe_x, config.probe_y));
+    probe_batch.push_back(pressures.back());
+    if (probe_batch.size() == PROBE_BATCH) {
+      const uint64_t first = step + 1 - PROBE_BATCH;
+      TelemetryRecord probe{TELEMETRY_PROBE, PROBE_BATCH, 0, 0, first,
+                            time - (PROBE_BATCH - 1) * sim.time_step()};
+      telemetry.publish(probe, probe_batch.data());
+      probe_batch.clear();
+    }
+    if (step % FIELD_EVERY == 0) {
+      publish_field(telemetry, sim, step, time, field_frame);
+    }
     EndDrawing();
-    prev_grid = grid;
-    grid = next_grid;
+    sim.step();
+    ++step;
   }
   std::ofstream outFile("output.txt");
 
@@ -391,6 +266,23 @@ int main() {
   } else {
     std::cerr << "Unable to open file for writing.\n";
   }
+
+  // One line per frequency bin: the frequency, then its 180 lobe magnitudes
+  std::ofstream beamFile("beam_patterns.txt");
+  if (beamFile.is_open()) {
+    std::vector<float> pattern;
+    for (int bin = 0; bin < lobe_spectra.bin_count(); ++bin) {
+      lobe_spectra.pattern(bin, pattern);
+      beamFile << lobe_spectra.bin_frequency(bin);
+      for (const float& val : pattern) {
+        beamFile << " " << val;
+      }
+      beamFile << "\n";
+    }
+    beamFile.close();
+  } else {
+    std::cerr << "Unable to open beam pattern file for writing.\n";
+  }
   CloseWindow();
   return 0;
 }
@@ -0,0 +1,98 @@
+/*
+    result_cache.hpp
+
+    On-disk cache of simulation results, keyed by the hash of the
+    SimConfig. Each result is stored in <dir>/<hash>.txt together with the
+    full config text. A load only succeeds if that text matches exactly,
+    so a hash collision just costs a recompute. Files are written to a
+    temporary name and renamed into place, so parallel runs never see a
+    half-written entry.
+*/
+#ifndef __SONAR_RESULT_CACHE_HPP
+#define __SONAR_RESULT_CACHE_HPP
+
+#include "sonar_sim.hpp"
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+class ResultCache {
+public:
+  explicit ResultCache(const std::string &dir) : dir(dir) {
+    std::filesystem::create_directories(dir);
+  }
+
+  std::string path(const SimConfig &config) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.txt",
+                  static_cast<unsigned long long>(config.hash()));
+    return dir + "/" + name;
+  }
+
+  bool load(const SimConfig &config, SimResult &result) const {
+    std::ifstream inFile(path(config));
+    if (!inFile.is_open()) {
+      return false;
+    }
+    std::string line;
+    std::string stored;
+    while (std::getline(inFile, line) && line != "end_config") {
+      stored += line + "\n";
+    }
+    if (stored != config.to_string()) {
+      return false;
+    }
+    return read_values(inFile, "lobes", result.lobes) &&
+           read_values(inFile, "probe", result.probe);
+  }
+
+  void store(const SimConfig &config, const SimResult &result) const {
+    std::string final_path = path(config);
+    std::ostringstream tmp_name;
+    tmp_name << final_path << ".tmp" << std::this_thread::get_id();
+    {
+      std::ofstream outFile(tmp_name.str());
+      if (!outFile.is_open()) {
+        return;
+      }
+      outFile << config.to_string() << "end_config\n";
+      write_values(outFile, "lobes", result.lobes);
+      write_values(outFile, "probe", result.probe);
+    }
+    std::rename(tmp_name.str().c_str(), final_path.c_str());
+  }
+
+private:
+  std::string dir;
+
+  static void write_values(std::ofstream &out, const char *name,
+                           const std::vector<float> &values) {
+    out << name << " " << values.size();
+    out.precision(9);
+    for (const float &num : values) {
+      out << " " << num;
+    }
+    out << "\n";
+  }
+
+  static bool read_values(std::ifstream &in, const char *name,
+                          std::vector<float> &values) {
+    std::string key;
+    size_t count;
+    if (!(in >> key >> count) || key != name) {
+      return false;
+    }
+    values.resize(count);
+    for (float &num : values) {
+      if (!(in >> num)) {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+
+#endif // __SONAR_RESULT_CACHE_HPP
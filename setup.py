@@ -0,0 +1,18 @@
+# Builds the sonar Python module from sonar_module.cpp:
+#   python3 setup.py build_ext --inplace
+from setuptools import Extension, setup
+
+setup(
+    name="sonar",
+    version="0.1",
+    description="Phased-array sonar FDTD simulation",
+    ext_modules=[
+        Extension(
+            "sonar",
+            sources=["sonar_module.cpp"],
+            depends=["sonar_sim.hpp", "spectral.hpp"],
+            extra_compile_args=["-std=c++17", "-O3", "-march=native"],
+            language="c++",
+        )
+    ],
+)
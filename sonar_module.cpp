@@ -0,0 +1,494 @@
+// Python bindings for the sonar simulation, built by setup.py:
+//
+//   python3 setup.py build_ext --inplace
+//
+//   import numpy as np, sonar
+//   sim = sonar.Simulation(steer_angle=20, wall_length=150)
+//   sim.step(5000)                 # runs without holding the GIL
+//   p = np.asarray(sim.field)      # (height, width) float32 view
+//   lobes = np.asarray(sim.lobes)  # beam pattern of the last full period
+//
+// field, probe and lobes are read-only buffer-protocol views; NumPy wraps
+// them without copying. Probe samples are written straight into the buffer
+// the views point at. field is NOT the solver's own buffer: the solver
+// rotates its time levels through three buffers, so field views a stable
+// copy that step() refreshes once when it returns. That is one grid copy
+// per step() call whatever n is, and the steps in between are never
+// visible; call step() with a smaller n to see more of them.
+//
+// While step() runs without the GIL, other Python threads only see what
+// the last step() published: the probe length, time and steps are
+// snapshots taken when it returns, and cell_mask() raises RuntimeError.
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include "sonar_sim.hpp"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+// Everything the Python object owns on the C++ side
+struct SimState {
+  Simulation sim;
+  std::vector<float> field; // current time level, refreshed by step()
+  std::vector<float> probe; // pressure at the probe point, every step
+  std::vector<float> lobes; // last full-period beam pattern
+  std::vector<float> lobes_latest;
+  std::vector<float> lobes_store;
+  std::vector<float> lobes_read;
+  float time = 0.0f; // float like run_simulation, so runs match it exactly
+  long long steps = 0;
+  int sample_index = 0;
+
+  // Copies of the above for Python, only written while holding the GIL
+  size_t probe_length = 0;
+  float published_time = 0.0f;
+  long long published_steps = 0;
+
+  SimState(const SimConfig &config, size_t probe_capacity)
+      : sim(config), field(sim.field()), lobes(180, 0.0f), lobes_latest(180, 0.0f),
+        lobes_store(180, 0.0f), lobes_read(180, 0.0f) {
+    probe.reserve(probe_capacity);
+  }
+
+  // Same sequence as run_simulation, without the GIL
+  void advance(long long n, bool transmit) {
+    const SimConfig &config = sim.config;
+    for (long long s = 0; s < n; ++s) {
+      time += sim.time_step();
+      if (transmit) {
+        sim.apply_pulse(time);
+      }
+      sim.read_lobes(lobes_read);
+      compare_lobes_pressures(lobes_store, lobes_read);
+      if (++sample_index == config.sim_per_freq) {
+        sample_index = 0;
+        lobes_latest = lobes_store;
+        std::fill(lobes_store.begin(), lobes_store.end(), 0.0f);
+      }
+      probe.push_back(sim.read_pressure(config.probe_x, config.probe_y));
+      sim.step();
+      ++steps;
+    }
+  }
+};
+
+enum BufferKind { FIELD_BUFFER, PROBE_BUFFER, LOBES_BUFFER, BUFFER_KINDS };
+
+struct SimObject {
+  PyObject_HEAD
+  SimState *state;
+  Py_ssize_t exports[BUFFER_KINDS];
+  bool stepping;
+};
+
+struct BufferObject {
+  PyObject_HEAD
+  SimObject *owner;
+  int kind;
+  Py_ssize_t shape[2];
+  Py_ssize_t strides[2];
+};
+
+static PyTypeObject SimType = {PyVarObject_HEAD_INIT(nullptr, 0)};
+static PyTypeObject BufferType = {PyVarObject_HEAD_INIT(nullptr, 0)};
+
+// ---- Buffer views -------------------------------------------------------
+
+static int buffer_getbuffer(PyObject *obj, Py_buffer *view, int flags) {
+  BufferObject *self = reinterpret_cast<BufferObject *>(obj);
+  if (flags & PyBUF_WRITABLE) {
+    PyErr_SetString(PyExc_BufferError, "simulation buffers are read-only");
+    return -1;
+  }
+  SimState &state = *self->owner->state;
+  static float empty = 0.0f;
+  float *data = nullptr;
+  if (self->kind == FIELD_BUFFER) {
+    data = state.field.data();
+    self->shape[0] = state.sim.height;
+    self->shape[1] = state.sim.width;
+    view->ndim = 2;
+  } else if (self->kind == PROBE_BUFFER) {
+    // Not probe.size(): a running step() may be appending to it
+    data = state.probe_length == 0 ? &empty : state.probe.data();
+    self->shape[0] = static_cast<Py_ssize_t>(state.probe_length);
+    view->ndim = 1;
+  } else {
+    data = state.lobes.data();
+    self->shape[0] = static_cast<Py_ssize_t>(state.lobes.size());
+    view->ndim = 1;
+  }
+  self->strides[view->ndim - 1] = sizeof(float);
+  if (view->ndim == 2) {
+    self->strides[0] = self->shape[1] * sizeof(float);
+  }
+
+  view->buf = data;
+  view->obj = obj;
+  Py_INCREF(obj);
+  view->len = self->shape[0] * (view->ndim == 2 ? self->shape[1] : 1) * sizeof(float);
+  view->itemsize = sizeof(float);
+  view->readonly = 1;
+  view->format = (flags & PyBUF_FORMAT) ? const_cast<char *>("f") : nullptr;
+  view->shape = (flags & PyBUF_ND) ? self->shape : nullptr;
+  view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? self->strides : nullptr;
+  view->suboffsets = nullptr;
+  view->internal = nullptr;
+  self->owner->exports[self->kind]++;
+  return 0;
+}
+
+static void buffer_releasebuffer(PyObject *obj, Py_buffer *) {
+  BufferObject *self = reinterpret_cast<BufferObject *>(obj);
+  self->owner->exports[self->kind]--;
+}
+
+static void buffer_dealloc(PyObject *obj) {
+  BufferObject *self = reinterpret_cast<BufferObject *>(obj);
+  Py_XDECREF(reinterpret_cast<PyObject *>(self->owner));
+  Py_TYPE(obj)->tp_free(obj);
+}
+
+static PyBufferProcs buffer_procs = {buffer_getbuffer, buffer_releasebuffer};
+
+// A memoryview over one of the simulation's buffers
+static PyObject *make_view(SimObject *owner, int kind) {
+  BufferObject *buffer = PyObject_New(BufferObject, &BufferType);
+  if (!buffer) {
+    return nullptr;
+  }
+  Py_INCREF(reinterpret_cast<PyObject *>(owner));
+  buffer->owner = owner;
+  buffer->kind = kind;
+  PyObject *view = PyMemoryView_FromObject(reinterpret_cast<PyObject *>(buffer));
+  Py_DECREF(reinterpret_cast<PyObject *>(buffer));
+  return view;
+}
+
+// ---- Simulation ---------------------------------------------------------
+
+static bool parse_floats(PyObject *seq, std::vector<float> &out, const char *what) {
+  PyObject *fast = PySequence_Fast(seq, what);
+  if (!fast) {
+    return false;
+  }
+  out.clear();
+  for (Py_ssize_t i = 0; i < PySequence_Fast_GET_SIZE(fast); ++i) {
+    double value = PyFloat_AsDouble(PySequence_Fast_GET_ITEM(fast, i));
+    if (value == -1.0 && PyErr_Occurred()) {
+      Py_DECREF(fast);
+      return false;
+    }
+    out.push_back(static_cast<float>(value));
+  }
+  Py_DECREF(fast);
+  return true;
+}
+
+static int sim_init(PyObject *obj, PyObject *args, PyObject *kwargs) {
+  SimObject *self = reinterpret_cast<SimObject *>(obj);
+  if (self->state) {
+    PyErr_SetString(PyExc_RuntimeError, "Simulation is already initialised");
+    return -1;
+  }
+  static const char *keywords[] = {
+      "width", "height", "refl_coef", "c", "pulse_freq", "sim_per_freq",
+      "amplitude", "steer_angle", "wave", "chirp_end_freq", "pulse_length",
+      "visual_wall", "wall_angles", "wall_length", "targets", "lobe_radius",
+      "probe", "probe_capacity", nullptr};
+  SimConfig config;
+  const char *wave = "tone";
+  int visual_wall = config.visual_wall;
+  PyObject *wall_angles = nullptr;
+  PyObject *targets = nullptr;
+  int probe_x = config.probe_x;
+  int probe_y = config.probe_y;
+  Py_ssize_t probe_capacity = 1 << 20;
+  if (!PyArg_ParseTupleAndKeywords(
+          args, kwargs, "|$iifffiffsffpOfOi(ii)n", const_cast<char **>(keywords),
+          &config.width, &config.height, &config.refl_coef, &config.c,
+          &config.pulse_freq, &config.sim_per_freq, &config.amplitude,
+          &config.steer_angle, &wave, &config.chirp_end_freq, &config.pulse_length,
+          &visual_wall, &wall_angles, &config.wall_length, &targets,
+          &config.lobe_radius, &probe_x, &probe_y, &probe_capacity)) {
+    return -1;
+  }
+  config.visual_wall = visual_wall;
+  config.probe_x = probe_x;
+  config.probe_y = probe_y;
+
+  if (!std::strcmp(wave, "tone")) {
+    config.wave_kind = Waveform::TONE;
+  } else if (!std::strcmp(wave, "chirp")) {
+    config.wave_kind = Waveform::CHIRP;
+  } else if (!std::strcmp(wave, "burst")) {
+    config.wave_kind = Waveform::BURST;
+  } else {
+    PyErr_SetString(PyExc_ValueError, "wave must be 'tone', 'chirp' or 'burst'");
+    return -1;
+  }
+  if (wall_angles && !parse_floats(wall_angles, config.wall_angles,
+                                   "wall_angles must be a sequence of degrees")) {
+    return -1;
+  }
+  if (targets) {
+    PyObject *fast = PySequence_Fast(targets, "targets must be a sequence");
+    if (!fast) {
+      return -1;
+    }
+    for (Py_ssize_t i = 0; i < PySequence_Fast_GET_SIZE(fast); ++i) {
+      std::vector<float> t;
+      if (!parse_floats(PySequence_Fast_GET_ITEM(fast, i), t,
+                        "a target is (x, y, vx, vy, rx, ry)") ||
+          t.size() != 6) {
+        if (!PyErr_Occurred()) {
+          PyErr_SetString(PyExc_ValueError, "a target is (x, y, vx, vy, rx, ry)");
+        }
+        Py_DECREF(fast);
+        return -1;
+      }
+      config.targets.push_back(TargetSpec{t[0], t[1], t[2], t[3], t[4], t[5]});
+    }
+    Py_DECREF(fast);
+  }
+
+  if (const char *error = config.invalid()) {
+    PyErr_SetString(PyExc_ValueError, error);
+    return -1;
+  }
+  if (probe_capacity < 0) {
+    PyErr_SetString(PyExc_ValueError, "probe_capacity must not be negative");
+    return -1;
+  }
+
+  try {
+    self->state = new SimState(config, static_cast<size_t>(probe_capacity));
+  } catch (const std::bad_alloc &) {
+    PyErr_NoMemory();
+    return -1;
+  }
+  return 0;
+}
+
+static void sim_dealloc(PyObject *obj) {
+  SimObject *self = reinterpret_cast<SimObject *>(obj);
+  delete self->state;
+  Py_TYPE(obj)->tp_free(obj);
+}
+
+static PyObject *sim_new(PyTypeObject *type, PyObject *, PyObject *) {
+  SimObject *self = reinterpret_cast<SimObject *>(type->tp_alloc(type, 0));
+  if (self) {
+    self->state = nullptr;
+    std::fill(self->exports, self->exports + BUFFER_KINDS, 0);
+    self->stepping = false;
+  }
+  return reinterpret_cast<PyObject *>(self);
+}
+
+static bool check_ready(SimObject *self) {
+  if (!self->state) {
+    PyErr_SetString(PyExc_RuntimeError, "Simulation.__init__ was not called");
+    return false;
+  }
+  return true;
+}
+
+static PyObject *sim_step(PyObject *obj, PyObject *args, PyObject *kwargs) {
+  SimObject *self = reinterpret_cast<SimObject *>(obj);
+  static const char *keywords[] = {"n", "transmit", nullptr};
+  long long n = 1;
+  int transmit = 1;
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|Lp", const_cast<char **>(keywords),
+                                   &n, &transmit) ||
+      !check_ready(self)) {
+    return nullptr;
+  }
+  if (n < 0) {
+    PyErr_SetString(PyExc_ValueError, "n must not be negative");
+    return nullptr;
+  }
+  if (self->stepping) {
+    PyErr_SetString(PyExc_RuntimeError, "Simulation is already stepping in another thread");
+    return nullptr;
+  }
+  SimState &state = *self->state;
+  // Probe views point into the probe vector, so it may only grow while
+  // nothing is exported, like a bytearray
+  const size_t needed = state.probe.size() + static_cast<size_t>(n);
+  if (needed > state.probe.capacity()) {
+    if (self->exports[PROBE_BUFFER] > 0) {
+      PyErr_SetString(PyExc_BufferError,
+                      "probe buffer is full and still exported; release the "
+                      "probe views or pass a larger probe_capacity");
+      return nullptr;
+    }
+    try {
+      state.probe.reserve(std::max(needed, 2 * state.probe.capacity()));
+    } catch (const std::bad_alloc &) {
+      return PyErr_NoMemory();
+    }
+  }
+
+  self->stepping = true;
+  Py_BEGIN_ALLOW_THREADS
+  state.advance(n, transmit != 0);
+  Py_END_ALLOW_THREADS
+  self->stepping = false;
+
+  // Publish the new state to the views while holding the GIL
+  const std::vector<float> &u = state.sim.field();
+  std::copy(u.begin(), u.end(), state.field.begin());
+  state.lobes = state.lobes_latest;
+  state.probe_length = state.probe.size();
+  state.published_time = state.time;
+  state.published_steps = state.steps;
+  Py_RETURN_NONE;
+}
+
+static PyObject *sim_get_view(PyObject *obj, void *closure) {
+  SimObject *self = reinterpret_cast<SimObject *>(obj);
+  if (!check_ready(self)) {
+    return nullptr;
+  }
+  return make_view(self, static_cast<int>(reinterpret_cast<intptr_t>(closure)));
+}
+
+static PyObject *sim_get_time(PyObject *obj, void *) {
+  SimObject *self = reinterpret_cast<SimObject *>(obj);
+  return check_ready(self) ? PyFloat_FromDouble(self->state->published_time) : nullptr;
+}
+
+static PyObject *sim_get_steps(PyObject *obj, void *) {
+  SimObject *self = reinterpret_cast<SimObject *>(obj);
+  return check_ready(self) ? PyLong_FromLongLong(self->state->published_steps) : nullptr;
+}
+
+static PyObject *sim_get_shape(PyObject *obj, void *) {
+  SimObject *self = reinterpret_cast<SimObject *>(obj);
+  if (!check_ready(self)) {
+    return nullptr;
+  }
+  return Py_BuildValue("(ii)", self->state->sim.height, self->state->sim.width);
+}
+
+static PyObject *sim_get_dt(PyObject *obj, void *) {
+  SimObject *self = reinterpret_cast<SimObject *>(obj);
+  return check_ready(self) ? PyFloat_FromDouble(self->state->sim.config.dt()) : nullptr;
+}
+
+static PyObject *sim_get_dx(PyObject *obj, void *) {
+  SimObject *self = reinterpret_cast<SimObject *>(obj);
+  return check_ready(self) ? PyFloat_FromDouble(self->state->sim.config.dx()) : nullptr;
+}
+
+static PyObject *sim_get_config(PyObject *obj, void *) {
+  SimObject *self = reinterpret_cast<SimObject *>(obj);
+  if (!check_ready(self)) {
+    return nullptr;
+  }
+  std::string text = self->state->sim.config.to_string();
+  return PyUnicode_FromStringAndSize(text.data(), text.size());
+}
+
+// 1 for wall cells, 2 for cells under a target, else 0; a copy
+static PyObject *sim_cell_mask(PyObject *obj, PyObject *) {
+  SimObject *self = reinterpret_cast<SimObject *>(obj);
+  if (!check_ready(self)) {
+    return nullptr;
+  }
+  // Moving targets rewrite the cells on every step
+  if (self->stepping) {
+    PyErr_SetString(PyExc_RuntimeError, "cell_mask() is not available while stepping");
+    return nullptr;
+  }
+  const Simulation &sim = self->state->sim;
+  PyObject *mask = PyBytes_FromStringAndSize(nullptr, sim.width * sim.height);
+  if (!mask) {
+    return nullptr;
+  }
+  char *out = PyBytes_AS_STRING(mask);
+  for (int y = 0; y < sim.height; ++y) {
+    for (int x = 0; x < sim.width; ++x) {
+      const Cell &cell = sim.cell(x, y);
+      out[y * sim.width + x] = cell.targets > 0 ? 2 : (cell.wall ? 1 : 0);
+    }
+  }
+  return mask;
+}
+
+static PyMethodDef sim_methods[] = {
+    {"step", reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)(void)>(sim_step)),
+     METH_VARARGS | METH_KEYWORDS,
+     "step(n=1, transmit=True)\n\nAdvance n time steps, driving the array while "
+     "transmit is true. The GIL is released while stepping."},
+    {"cell_mask", sim_cell_mask, METH_NOARGS,
+     "cell_mask() -> bytes\n\nheight*width bytes: 1 wall, 2 target, 0 water."},
+    {nullptr, nullptr, 0, nullptr}};
+
+static PyGetSetDef sim_getset[] = {
+    {"field", sim_get_view, nullptr,
+     "Pressure field, read-only float32 view of shape (height, width).\n\n"
+     "The view is of a copy of the solver's current time level, taken once\n"
+     "when step() returns: every step() call copies the whole grid once,\n"
+     "however many steps it takes, and the steps in between are not seen.\n"
+     "Views stay valid and show the new copy after each step().",
+     reinterpret_cast<void *>(FIELD_BUFFER)},
+    {"probe", sim_get_view, nullptr,
+     "Pressure at the probe point for every step so far, read-only float32 view",
+     reinterpret_cast<void *>(PROBE_BUFFER)},
+    {"lobes", sim_get_view, nullptr,
+     "Peak |pressure| per degree over the last full period, read-only float32 view",
+     reinterpret_cast<void *>(LOBES_BUFFER)},
+    {"time", sim_get_time, nullptr, "Simulated seconds", nullptr},
+    {"steps", sim_get_steps, nullptr, "Time steps taken", nullptr},
+    {"shape", sim_get_shape, nullptr, "(height, width) in cells", nullptr},
+    {"dt", sim_get_dt, nullptr, "Seconds per step", nullptr},
+    {"dx", sim_get_dx, nullptr, "Metres per cell", nullptr},
+    {"config", sim_get_config, nullptr, "Canonical config text", nullptr},
+    {nullptr, nullptr, nullptr, nullptr, nullptr}};
+
+static PyModuleDef sonar_module = {PyModuleDef_HEAD_INIT, "sonar",
+                                   "Phased-array sonar FDTD simulation.", -1,
+                                   nullptr};
+
+PyMODINIT_FUNC PyInit_sonar(void) {
+  BufferType.tp_name = "sonar._Buffer";
+  BufferType.tp_basicsize = sizeof(BufferObject);
+  BufferType.tp_flags = Py_TPFLAGS_DEFAULT;
+  BufferType.tp_dealloc = buffer_dealloc;
+  BufferType.tp_as_buffer = &buffer_procs;
+  BufferType.tp_doc = "Exporter behind the Simulation buffer views";
+
+  SimType.tp_name = "sonar.Simulation";
+  SimType.tp_basicsize = sizeof(SimObject);
+  SimType.tp_flags = Py_TPFLAGS_DEFAULT;
+  SimType.tp_new = sim_new;
+  SimType.tp_init = sim_init;
+  SimType.tp_dealloc = sim_dealloc;
+  SimType.tp_methods = sim_methods;
+  SimType.tp_getset = sim_getset;
+  SimType.tp_doc =
+      "Simulation(*, width=200, height=200, refl_coef=0.7, c=343, pulse_freq=40000,\n"
+      "           sim_per_freq=10, amplitude=2, steer_angle=30, wave='tone',\n"
+      "           chirp_end_freq=50000, pulse_length=0.0005, visual_wall=True,\n"
+      "           wall_angles=(30, 45, 60, 0, -60, -45, -30), wall_length=200,\n"
+      "           targets=(), lobe_radius=50, probe=(50, 1), probe_capacity=2**20)\n\n"
+      "targets are (x, y, vx, vy, rx, ry) tuples in cells and m/s.";
+
+  if (PyType_Ready(&BufferType) < 0 || PyType_Ready(&SimType) < 0) {
+    return nullptr;
+  }
+  PyObject *module = PyModule_Create(&sonar_module);
+  if (!module) {
+    return nullptr;
+  }
+  Py_INCREF(&SimType);
+  if (PyModule_AddObject(module, "Simulation", reinterpret_cast<PyObject *>(&SimType)) < 0) {
+    Py_DECREF(&SimType);
+    Py_DECREF(module);
+    return nullptr;
+  }
+  return module;
+}
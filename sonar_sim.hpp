@@ -0,0 +1,543 @@
+/*
+    sonar_sim.hpp
+
+    The FDTD pressure-grid solver from main.cpp, with the parameters that
+    used to be const globals collected in SimConfig. Several Simulation
+    objects can exist at once (parameter sweeps, bindings), and each one
+    runs single-threaded.
+*/
+#ifndef __SONAR_SIM_HPP
+#define __SONAR_SIM_HPP
+
+#include "spectral.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+const float PI_F = 3.14159265358979f;
+
+inline float deg2rad(float angle) {
+  return angle * (PI_F / 180.0);
+}
+
+// A moving target is an ellipse rx by ry cells, moving at vx, vy in m/s
+struct TargetSpec {
+  float x, y;
+  float vx, vy;
+  float rx, ry;
+};
+
+struct SimConfig {
+  float refl_coef = 0.7f;     // Reflection coeficient
+  float c = 343.0f;           // Speed of sound constant
+  float pulse_freq = 40000.0f; // Frequency in Hz
+  int sim_per_freq = 10; // number of simulations that will get run per frequency
+  float amplitude = 2.0f; // Amplitude of the pulse
+  float steer_angle = 30.0f; // Beam steering angle in degrees, works up to 45
+  Waveform::Kind wave_kind = Waveform::TONE;
+  float chirp_end_freq = 50000.0f; // CHIRP sweeps from pulse_freq to this
+  float pulse_length = 0.0005f;    // seconds, for CHIRP and BURST
+  int width = 200; // Model assumes 100x100 represents 1m x 1m area irl
+  int height = 200;
+  bool visual_wall = true; // walls are drawn but don't reflect
+  // Walls fan out from the bottom centre, degrees off vertical
+  std::vector<float> wall_angles = {30, 45, 60, 0, -60, -45, -30};
+  float wall_length = 200; // cells
+  std::vector<TargetSpec> targets;
+  int lobe_radius = 50; // cells from the array centre
+  int probe_x = 50;
+  int probe_y = 1;
+  // Used by headless runs only
+  int steps = 2000;
+  int pulse_steps = 2000; // transmit for this many steps, then listen
+
+  // Gamma - used for absorbing walls
+  float g() const { return (1 - refl_coef) / (1 + refl_coef); }
+  float lf() const { return 0.5 * std::sqrt(0.5) * g(); } // Loss factor
+  int sim_rate() const { return pulse_freq * sim_per_freq; }
+  float dt() const { return 1.0 / sim_rate(); }
+  // dt <= dx/C | dx >= C*dt
+  float dx() const { return (c * dt()) / std::sqrt(0.5); }
+  float wave_length() const { return c / pulse_freq; }
+
+  // Why the grid cannot be simulated as configured, or nullptr if it can.
+  // The array spans 13 cells at the bottom centre and the lobe points sit
+  // lobe_radius around it, so all of them must be inside the grid.
+  const char *invalid() const {
+    if (width < 16 || height < 4 || sim_per_freq < 2 || pulse_freq <= 0.0f ||
+        c <= 0.0f) {
+      return "grid must be at least 16x4 cells, with positive pulse_freq and c, "
+             "sim_per_freq >= 2";
+    }
+    if (lobe_radius < 1 || lobe_radius >= width / 2 || lobe_radius > height - 3) {
+      return "lobe_radius must fit inside the grid";
+    }
+    if (probe_x < 0 || probe_x >= width || probe_y < 0 || probe_y >= height) {
+      return "probe must be inside the grid";
+    }
+    return nullptr;
+  }
+
+  // Phase of array element n relative to element 0 when steering
+  float element_phase() const {
+    float radian = deg2rad(steer_angle);
+    float phase_shift = (2 * PI_F * (wave_length()/2) * std::sin(radian))/wave_length()/2;
+    if (steer_angle > 90) {
+      phase_shift *= -1;
+    }
+    return phase_shift;
+  }
+
+  Waveform waveform() const {
+    if (wave_kind == Waveform::CHIRP) {
+      return Waveform::chirp(pulse_freq, chirp_end_freq, pulse_length, amplitude);
+    }
+    if (wave_kind == Waveform::BURST) {
+      return Waveform::burst(pulse_freq, pulse_length, amplitude);
+    }
+    return Waveform::tone(pulse_freq, amplitude);
+  }
+
+  // Canonical text form, one key=value per line. Two configs that
+  // simulate the same thing give the same text.
+  std::string to_string() const {
+    std::string s;
+    auto add = [&s](const char *key, double value) {
+      char buffer[64];
+      std::snprintf(buffer, sizeof(buffer), "%s=%.9g\n", key, value);
+      s += buffer;
+    };
+    add("refl_coef", refl_coef);
+    add("c", c);
+    add("pulse_freq", pulse_freq);
+    add("sim_per_freq", sim_per_freq);
+    add("amplitude", amplitude);
+    add("steer_angle", steer_angle);
+    add("wave_kind", wave_kind);
+    if (wave_kind == Waveform::CHIRP) {
+      add("chirp_end_freq", chirp_end_freq);
+    }
+    if (wave_kind != Waveform::TONE) {
+      add("pulse_length", pulse_length);
+    }
+    add("width", width);
+    add("height", height);
+    add("visual_wall", visual_wall);
+    for (float angle : wall_angles) {
+      add("wall_angle", angle);
+    }
+    add("wall_length", wall_length);
+    for (const TargetSpec &t : targets) {
+      add("target_x", t.x);
+      add("target_y", t.y);
+      add("target_vx", t.vx);
+      add("target_vy", t.vy);
+      add("target_rx", t.rx);
+      add("target_ry", t.ry);
+    }
+    add("lobe_radius", lobe_radius);
+    add("probe_x", probe_x);
+    add("probe_y", probe_y);
+    add("steps", steps);
+    add("pulse_steps", pulse_steps);
+    return s;
+  }
+
+  // 64-bit FNV-1a of to_string()
+  uint64_t hash() const {
+    uint64_t h = 14695981039346656037ull;
+    for (unsigned char ch : to_string()) {
+      h ^= ch;
+      h *= 1099511628211ull;
+    }
+    return h;
+  }
+};
+
+// Columns of the transducer elements, centred on a grid width cells wide
+inline std::vector<int> array_columns(int width) {
+  int antena_spacing = 2; // half a wavelength in pixels
+  std::vector<int> xs;
+  for (int n = 0; n < 7; ++n) {
+    xs.push_back(width / 2 + antena_spacing * (n - 3));
+  }
+  return xs;
+}
+
+inline std::vector<std::pair<int, int>> bresenham_line(int x0, int y0, int x1,
+                                                       int y1) {
+  std::vector<std::pair<int, int>> points;
+  int dx = abs(x1 - x0);
+  int dy = abs(y1 - y0);
+  int sx = (x0 < x1) ? 1 : -1;
+  int sy = (y0 < y1) ? 1 : -1;
+  int err = dx - dy;
+
+  while (true) {
+    points.push_back(
+        std::make_pair(x0, y0)); // Add the current point to the list
+    if (x0 == x1 && y0 == y1) {  // If we've reached the end point, stop
+      break;
+    }
+    int e2 = 2 * err;
+    if (e2 > -dy) {
+      err -= dy;
+      x0 += sx;
+    }
+    if (e2 < dx) {
+      err += dx;
+      y0 += sy;
+    }
+  }
+
+  return points;
+}
+
+// Rasterize a filled ellipse with rx, ry radius in cells
+inline std::vector<std::pair<int, int>> ellipse_shape(float rx, float ry) {
+  std::vector<std::pair<int, int>> shape;
+  int ix = static_cast<int>(std::ceil(rx));
+  int iy = static_cast<int>(std::ceil(ry));
+  for (int dy = -iy; dy <= iy; ++dy) {
+    for (int dx = -ix; dx <= ix; ++dx) {
+      float ex = dx / rx;
+      float ey = dy / ry;
+      if (ex * ex + ey * ey <= 1.0f) {
+        shape.push_back(std::make_pair(dx, dy));
+      }
+    }
+  }
+  return shape;
+}
+
+struct MovingTarget {
+  float x, y;   // centre position in cells
+  float vx, vy; // velocity in m/s
+  std::vector<std::pair<int, int>> shape; // footprint offsets from the centre
+  int cx, cy;   // centre the current footprint was rasterized at
+  bool placed;
+
+  MovingTarget(float x, float y, float vx, float vy,
+               std::vector<std::pair<int, int>> shape)
+      : x(x), y(y), vx(vx), vy(vy), shape(std::move(shape)),
+        cx(0), cy(0), placed(false) {}
+};
+
+struct Cell {
+  bool wall;
+  int targets; // number of moving targets currently covering the cell
+  int k; // boundary coefficient - neighbours that take part in the stencil
+
+  Cell() : wall(false), targets(0), k(4) {}
+};
+
+class Simulation {
+public:
+  const SimConfig config;
+  const int width;
+  const int height;
+
+  explicit Simulation(const SimConfig &config)
+      : config(config), width(config.width), height(config.height),
+        dt(config.dt()), dx(config.dx()), lf(config.lf()),
+        waveform(config.waveform()), cells(width * height),
+        u(width * height, 0.0f), u_prev(width * height, 0.0f),
+        u_next(width * height, 0.0f) {
+    set_wall_cells(fan_walls());
+    init_boundary_map();
+    for (const TargetSpec &t : config.targets) {
+      targets.emplace_back(t.x, t.y, t.vx, t.vy, ellipse_shape(t.rx, t.ry));
+    }
+    // Rasterize the targets where they start
+    update_moving_targets(0.0f);
+  }
+
+  float time_step() const { return dt; }
+  const Cell &cell(int x, int y) const { return cells[index(x, y)]; }
+  const std::vector<MovingTarget> &moving_targets() const { return targets; }
+
+  // Pressure field, row-major width * height
+  const std::vector<float> &field() const { return u; }
+
+  float read_pressure(int x, int y) const { return u[index(x, y)]; }
+
+  // Whether step() computes this cell: false on the border ring, under
+  // targets, and in walls unless they are only visual
+  bool updates_cell(int x, int y) const {
+    return x > 0 && x < width - 1 && y > 0 && y < height - 1 &&
+           is_updated(cells[index(x, y)]);
+  }
+
+  // Wall polyline: alternately the array centre and the end of each wall
+  std::vector<std::pair<int, int>> fan_walls() const {
+    std::vector<std::pair<int, int>> wall_line_list;
+    for (float angle : config.wall_angles) {
+      wall_line_list.push_back({width / 2, height});
+      wall_line_list.push_back(
+          {static_cast<int>(width / 2 + config.wall_length * std::cos(deg2rad(90 - angle))),
+           static_cast<int>(height - config.wall_length * std::sin(deg2rad(90 - angle)))});
+    }
+    return wall_line_list;
+  }
+
+  void set_wall_cells(const std::vector<std::pair<int, int>> &wall_line_list) {
+    for (size_t i = 0; i + 1 < wall_line_list.size(); ++i) {
+      int x0 = wall_line_list[i].first;
+      int y0 = wall_line_list[i].second;
+      int x1 = wall_line_list[i + 1].first;
+      int y1 = wall_line_list[i + 1].second;
+
+      // Generate all points between these two coordinates
+      std::vector<std::pair<int, int>> line_points =
+          bresenham_line(x0, y0, x1, y1);
+
+      // Set the corresponding cells in the grid as walls
+      for (const auto &point : line_points) {
+        int x = point.first;
+        int y = point.second;
+
+        // Check if coordinates are within grid bounds
+        if (x >= 0 && x < width && y >= 0 && y < height) {
+          cells[index(x, y)].wall = true;
+        }
+      }
+    }
+  }
+
+  // Element x positions of the transducer array, all on row array_y()
+  std::vector<int> array_elements() const { return array_columns(width); }
+  int array_y() const { return height - 2; }
+
+  // Phase of element n relative to element 0 when steering
+  float element_phase() const { return config.element_phase(); }
+
+  void apply_pulse(float time) {
+    // The phase shift at pulse_freq as a time delay per element, so chirps
+    // and bursts are steered the same way for every frequency they contain
+    float element_delay = element_phase() / (2 * PI_F * config.pulse_freq);
+    std::vector<int> xs = array_elements();
+    for (size_t n = 0; n < xs.size(); ++n) {
+      const int i = index(xs[n], array_y());
+      // An element under a target is silent: step() relies on covered
+      // cells staying zero in all three buffers
+      if (cells[i].targets > 0) {
+        continue;
+      }
+      u[i] = waveform.value(time + element_delay * n);
+    }
+  }
+
+  // Lobe sample points: 180 points, one per degree, lobe_radius around the
+  // centre bottom (pulse source)
+  std::pair<int, int> lobe_point(int degree) const {
+    int r = config.lobe_radius;
+    int x = width/2 - static_cast<int>(r*std::cos(deg2rad(degree)));
+    int y = height-2 - static_cast<int>(r*std::sin(deg2rad(degree)));
+    return std::make_pair(x, y);
+  }
+
+  void read_lobes(std::vector<float> &lobes_pressure) const {
+    lobes_pressure.resize(180);
+    for (int i = 0; i < 180; ++i) {
+      std::pair<int, int> p = lobe_point(i);
+      lobes_pressure[i] = read_pressure(p.first, p.second);
+    }
+  }
+
+  // Advance one time step: move targets, update the grid, rotate buffers
+  void step() {
+    update_moving_targets(dt);
+
+    for (int y = 1; y < height - 1; ++y) {
+      for (int x = 1; x < width - 1; ++x) {
+        const int i = index(x, y);
+        if (is_updated(cells[i])) {
+          u_next[i] = calculate_pressure(i, cells[i].k);
+        }
+      }
+    }
+    // Cells that are not updated are zero in all three buffers
+    std::swap(u_prev, u);
+    std::swap(u, u_next);
+  }
+
+private:
+  float dt;
+  float dx;
+  float lf;
+  Waveform waveform;
+  std::vector<Cell> cells;
+  std::vector<float> u;
+  std::vector<float> u_prev;
+  std::vector<float> u_next;
+  std::vector<MovingTarget> targets;
+  // Cells that entered or left a target footprint during the current step
+  std::vector<std::pair<int, int>> changed_cells;
+
+  int index(int x, int y) const { return y * width + x; }
+
+  float calculate_pressure(int i, int k) const {
+    float val =
+      (1 / (1 + lf * (4 - k))) * ((2 - 0.5 * k) * u[i] +
+      0.5 * (u[i + 1] + u[i - 1] +
+      u[i + width] + u[i - width]) +
+      (lf * (4 - k) - 1) * u_prev[i]);
+
+    return val;
+  }
+
+  // A cell blocks the stencil of its neighbours if it is a solid wall or is
+  // covered by a moving target (targets are always rigid, even with visual_wall)
+  bool is_blocking(const Cell &cell) const {
+    return (cell.wall && !config.visual_wall) || cell.targets > 0;
+  }
+
+  bool is_updated(const Cell &cell) const {
+    return (!cell.wall || config.visual_wall) && cell.targets == 0;
+  }
+
+  int compute_cell_k(int x, int y) const {
+    int k = 4;
+    if (y == 1 || y == height - 2) {
+      k -= 1;
+    }
+    if (x == 1 || x == width - 2) {
+      k -= 1;
+    }
+    if (is_blocking(cells[index(x + 1, y)])) k -= 1;
+    if (is_blocking(cells[index(x - 1, y)])) k -= 1;
+    if (is_blocking(cells[index(x, y + 1)])) k -= 1;
+    if (is_blocking(cells[index(x, y - 1)])) k -= 1;
+    return k;
+  }
+
+  // Boundary map: k only changes when walls or targets move, so it is
+  // computed once here and patched locally by refresh_boundary afterwards
+  void init_boundary_map() {
+    for (int y = 1; y < height - 1; ++y) {
+      for (int x = 1; x < width - 1; ++x) {
+        cells[index(x, y)].k = compute_cell_k(x, y);
+      }
+    }
+  }
+
+  // Recompute k for a cell whose blocking state changed, and its neighbours
+  void refresh_boundary(int x, int y) {
+    const std::pair<int, int> around[] = {
+        {x, y}, {x + 1, y}, {x - 1, y}, {x, y + 1}, {x, y - 1}};
+    for (const auto &c : around) {
+      if (c.first < 1 || c.first > width - 2 || c.second < 1 || c.second > height - 2) {
+        continue;
+      }
+      cells[index(c.first, c.second)].k = compute_cell_k(c.first, c.second);
+    }
+  }
+
+  void set_cell_targets(int x, int y, int delta) {
+    if (x < 1 || x > width - 2 || y < 1 || y > height - 2) {
+      return;
+    }
+    const int i = index(x, y);
+    int before = cells[i].targets;
+    int after = before + delta;
+    cells[i].targets = after;
+    if ((before == 0) != (after == 0)) {
+      // Both entering and vacated cells start from rest
+      u[i] = 0.0f;
+      u_prev[i] = 0.0f;
+      u_next[i] = 0.0f;
+      changed_cells.push_back(std::make_pair(x, y));
+    }
+  }
+
+  // Move the targets and patch the boundary map only where footprints
+  // changed. Cells covered by both the old and the new footprint are left
+  // untouched.
+  void update_moving_targets(float step_dt) {
+    changed_cells.clear();
+    for (MovingTarget &target : targets) {
+      target.x += target.vx * step_dt / dx;
+      target.y += target.vy * step_dt / dx;
+      int cx = static_cast<int>(std::lround(target.x));
+      int cy = static_cast<int>(std::lround(target.y));
+      if (target.placed && cx == target.cx && cy == target.cy) {
+        continue;
+      }
+      for (const auto &offset : target.shape) {
+        set_cell_targets(cx + offset.first, cy + offset.second, 1);
+      }
+      if (target.placed) {
+        for (const auto &offset : target.shape) {
+          set_cell_targets(target.cx + offset.first, target.cy + offset.second, -1);
+        }
+      }
+      target.cx = cx;
+      target.cy = cy;
+      target.placed = true;
+    }
+    for (const auto &c : changed_cells) {
+      refresh_boundary(c.first, c.second);
+    }
+  }
+};
+
+inline void compare_lobes_pressures(std::vector<float> &lobes_pressure1,
+                                    const std::vector<float> &lobes_pressure2) {
+  for (size_t i = 0; i < lobes_pressure1.size() && i < lobes_pressure2.size(); ++i) {
+    lobes_pressure1[i] = std::max(std::fabs(lobes_pressure1[i]), std::fabs(lobes_pressure2[i]));
+  }
+}
+
+struct SimResult {
+  std::vector<float> lobes; // beam pattern: peak |pressure| per degree
+  std::vector<float> probe; // pressure at the probe point, every step
+};
+
+// Step any simulation with the Simulation stepping interface (time_step,
+// apply_pulse, read_lobes, read_pressure, step) for config.steps steps. The
+// beam pattern is the lobe sampler's last full window of sim_per_freq
+// samples, as drawn by main.
+template <class Sim> SimResult run_steps(Sim &sim, const SimConfig &config) {
+  SimResult result;
+  result.probe.reserve(config.steps);
+  std::vector<float> lobes_pressure_store(180, 0.0);
+  std::vector<float> lobes_pressure_read(180, 0.0);
+  float time = 0.0;
+  int sample_index = 0;
+
+  for (int n = 0; n < config.steps; ++n) {
+    time += sim.time_step();
+    if (n < config.pulse_steps) {
+      sim.apply_pulse(time);
+    }
+    sim.read_lobes(lobes_pressure_read);
+    compare_lobes_pressures(lobes_pressure_store, lobes_pressure_read);
+    if (++sample_index == config.sim_per_freq) {
+      sample_index = 0;
+      result.lobes = lobes_pressure_store;
+      std::fill(lobes_pressure_store.begin(), lobes_pressure_store.end(), 0.0);
+    }
+    result.probe.push_back(sim.read_pressure(config.probe_x, config.probe_y));
+    sim.step();
+  }
+  if (result.lobes.empty()) {
+    result.lobes = lobes_pressure_store;
+  }
+  return result;
+}
+
+// Run a config headless for config.steps steps.
+// Returns an empty result if config.invalid().
+inline SimResult run_simulation(const SimConfig &config) {
+  if (config.invalid()) {
+    return SimResult();
+  }
+  Simulation sim(config);
+  return run_steps(sim, config);
+}
+
+#endif // __SONAR_SIM_HPP
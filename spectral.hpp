@@ -0,0 +1,146 @@
+/*
+    spectral.hpp
+
+    Transmit waveforms and streaming spectral probes.
+
+    Waveform gives the signal driven into each transducer element. Steering
+    uses a per-element time delay. For a tone this is the same as the old
+    per-element phase shift. For chirps and bursts it is true time-delay
+    steering, so every frequency in the pulse is steered to the same angle.
+
+    SpectralProbes keeps one running Goertzel filter per (point, frequency
+    bin). Each sample costs O(bins) per point, memory is two doubles per
+    bin, and no time series is stored. Magnitudes can be read at any time.
+*/
+#ifndef __SONAR_SPECTRAL_HPP
+#define __SONAR_SPECTRAL_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+struct Waveform {
+  enum Kind {
+    TONE,  // continuous sine at f0
+    CHIRP, // linear FM sweep from f0 to f1 over duration, tapered ends
+    BURST  // Hann-windowed tone burst at f0 lasting duration
+  };
+
+  Kind kind;
+  float f0;
+  float f1;
+  float duration; // seconds, unused for TONE
+  float amplitude;
+
+  static Waveform tone(float freq, float amplitude) {
+    return Waveform{TONE, freq, freq, 0.0f, amplitude};
+  }
+  static Waveform chirp(float f0, float f1, float duration, float amplitude) {
+    return Waveform{CHIRP, f0, f1, duration, amplitude};
+  }
+  static Waveform burst(float freq, float duration, float amplitude) {
+    return Waveform{BURST, freq, freq, duration, amplitude};
+  }
+
+  float value(float t) const {
+    const double two_pi = 6.283185307179586;
+    if (kind == TONE) {
+      return amplitude * std::sin(two_pi * f0 * t);
+    }
+    if (t < 0.0f || t >= duration) {
+      return 0.0f;
+    }
+    if (kind == BURST) {
+      float window = 0.5f - 0.5f * std::cos(two_pi * t / duration);
+      return amplitude * window * std::sin(two_pi * f0 * t);
+    }
+    // Tukey window, cosine tapers over the first and last 10%
+    const float taper = 0.1f * duration;
+    float window = 1.0f;
+    if (t < taper) {
+      window = 0.5f - 0.5f * std::cos(M_PI * t / taper);
+    } else if (t > duration - taper) {
+      window = 0.5f - 0.5f * std::cos(M_PI * (duration - t) / taper);
+    }
+    double phase = two_pi * (f0 * t + 0.5 * (f1 - f0) * t * t / duration);
+    return amplitude * window * std::sin(phase);
+  }
+};
+
+class SpectralProbes {
+public:
+  // points - number of probe points fed by every add_samples call
+  // freqs  - bin centre frequencies in Hz
+  // sample_rate - samples per second of the fed signal
+  SpectralProbes(int points, const std::vector<float> &freqs, float sample_rate)
+      : points(points), freqs(freqs), coeff(freqs.size()),
+        s1(points * freqs.size(), 0.0), s2(points * freqs.size(), 0.0) {
+    for (size_t b = 0; b < freqs.size(); ++b) {
+      coeff[b] = 2.0 * std::cos(2.0 * M_PI * freqs[b] / sample_rate);
+    }
+  }
+
+  // Evenly spaced bins from f_lo to f_hi inclusive
+  static std::vector<float> linear_bins(float f_lo, float f_hi, int bins) {
+    std::vector<float> freqs(bins);
+    for (int b = 0; b < bins; ++b) {
+      freqs[b] = bins > 1 ? f_lo + (f_hi - f_lo) * b / (bins - 1) : f_lo;
+    }
+    return freqs;
+  }
+
+  int point_count() const { return points; }
+  int bin_count() const { return static_cast<int>(freqs.size()); }
+  float bin_frequency(int bin) const { return freqs[bin]; }
+  long sample_count() const { return samples; }
+
+  // One new sample for every point
+  void add_samples(const float *values) {
+    const int bins = bin_count();
+    for (int p = 0; p < points; ++p) {
+      const double x = values[p];
+      double *a = &s1[p * bins];
+      double *b = &s2[p * bins];
+      for (int k = 0; k < bins; ++k) {
+        const double s = x + coeff[k] * a[k] - b[k];
+        b[k] = a[k];
+        a[k] = s;
+      }
+    }
+    ++samples;
+  }
+
+  // Amplitude of the bin's sinusoid at point p (averaged over all samples)
+  float magnitude(int p, int bin) const {
+    if (samples == 0) {
+      return 0.0f;
+    }
+    const int i = p * bin_count() + bin;
+    double power = s1[i] * s1[i] + s2[i] * s2[i] - coeff[bin] * s1[i] * s2[i];
+    return static_cast<float>(2.0 * std::sqrt(std::fmax(power, 0.0)) / samples);
+  }
+
+  // Magnitude of one bin at every point, e.g. a beam pattern over the lobes
+  void pattern(int bin, std::vector<float> &out) const {
+    out.resize(points);
+    for (int p = 0; p < points; ++p) {
+      out[p] = magnitude(p, bin);
+    }
+  }
+
+  void reset() {
+    std::fill(s1.begin(), s1.end(), 0.0);
+    std::fill(s2.begin(), s2.end(), 0.0);
+    samples = 0;
+  }
+
+private:
+  int points;
+  std::vector<float> freqs;
+  std::vector<double> coeff;
+  std::vector<double> s1; // [point][bin] Goertzel state s[n-1]
+  std::vector<double> s2; // [point][bin] Goertzel state s[n-2]
+  long samples = 0;
+};
+
+#endif // __SONAR_SPECTRAL_HPP
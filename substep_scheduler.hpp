@@ -0,0 +1,89 @@
+/*
+    substep_scheduler.hpp
+
+    Decides how many fixed-size simulation steps to run per rendered frame so
+    that simulated time advances at a chosen real-time factor (RTF):
+        simulated seconds = RTF * wall-clock seconds.
+
+    The cost of one step is measured online. When the steps needed to reach
+    the target RTF do not fit in the per-frame budget, the scheduler runs only
+    what fits and drops the rest instead of building up a backlog, so the
+    achieved RTF drops smoothly and is reported through achieved_rtf().
+*/
+#ifndef __SONAR_SUBSTEP_SCHEDULER_HPP
+#define __SONAR_SUBSTEP_SCHEDULER_HPP
+
+#include <algorithm>
+#include <cmath>
+
+class SubstepScheduler {
+public:
+  // dt          - simulated seconds per step
+  // target_rtf  - wanted simulated seconds per wall-clock second
+  // budget      - wall-clock seconds per frame that stepping may use
+  SubstepScheduler(double dt, double target_rtf, double budget)
+      : dt(dt), target(target_rtf), budget(budget) {}
+
+  // Number of steps to run for a frame that took wall_dt seconds
+  int plan(double wall_dt) {
+    // A stalled frame (window drag, breakpoint) must not turn into a burst
+    wall_dt = std::min(wall_dt, MAX_FRAME_TIME);
+    last_wall_dt = wall_dt;
+
+    double wanted = carry + (wall_dt * target) / dt;
+    int steps = static_cast<int>(std::floor(wanted));
+    int affordable = step_cost > 0.0
+                         ? static_cast<int>(budget / step_cost)
+                         : 1; // one step to get a first measurement
+    affordable = std::max(affordable, 1);
+
+    if (steps > affordable) {
+      steps = affordable;
+      carry = 0.0;
+      is_degraded = true;
+    } else {
+      carry = wanted - steps;
+      is_degraded = false;
+    }
+    return steps;
+  }
+
+  // Report how long the planned steps actually took
+  void record(int steps, double seconds) {
+    if (steps > 0) {
+      double cost = seconds / steps;
+      step_cost = step_cost > 0.0
+                      ? (1.0 - COST_SMOOTHING) * step_cost + COST_SMOOTHING * cost
+                      : cost;
+    }
+    sim_seconds += steps * dt;
+    if (last_wall_dt > 0.0) {
+      double rtf = (steps * dt) / last_wall_dt;
+      rtf_average = (1.0 - RTF_SMOOTHING) * rtf_average + RTF_SMOOTHING * rtf;
+    }
+  }
+
+  void set_target_rtf(double rtf) { target = std::max(rtf, 0.0); }
+  double target_rtf() const { return target; }
+  double achieved_rtf() const { return rtf_average; }
+  double cost_per_step() const { return step_cost; }
+  double sim_time() const { return sim_seconds; }
+  bool degraded() const { return is_degraded; }
+
+private:
+  static constexpr double MAX_FRAME_TIME = 0.1;
+  static constexpr double COST_SMOOTHING = 0.1;
+  static constexpr double RTF_SMOOTHING = 0.05;
+
+  double dt;
+  double target;
+  double budget;
+  double carry = 0.0; // fraction of a step left over from the last frame
+  double step_cost = 0.0;
+  double last_wall_dt = 0.0;
+  double rtf_average = 0.0;
+  double sim_seconds = 0.0;
+  bool is_degraded = false;
+};
+
+#endif // __SONAR_SUBSTEP_SCHEDULER_HPP
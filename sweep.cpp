@@ -0,0 +1,206 @@
+#include "result_cache.hpp"
+#include "sonar_sim.hpp"
+#include "work_stealing.hpp"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Parameter sweep runner. Every combination of the given values is one
+// single-threaded simulation; the simulations are spread over all cores.
+// Results are cached by config hash, so re-running or extending a sweep
+// only computes the new points.
+//
+//   sweep --angle 0:45:15 --freq 30000,40000 --refl 0.5,0.7
+//
+// LIST is comma separated values or start:stop:step. The lobe radius and
+// the probe position scale with --size from their defaults at 200 cells;
+// points whose config is still invalid are reported and skipped.
+
+void print_usage() {
+  std::cerr
+      << "usage: sweep [options]\n"
+         "  --angle LIST        steering angle in degrees\n"
+         "  --freq LIST         pulse frequency in Hz\n"
+         "  --refl LIST         wall reflection coefficient\n"
+         "  --wall-length LIST  length of the fan walls in cells\n"
+         "  --size LIST         width and height of the grid in cells\n"
+         "  --steps N           steps per simulation (default 2000)\n"
+         "  --threads N         worker threads (default: all cores)\n"
+         "  --cache DIR         result cache (default sweep_cache)\n"
+         "  --out FILE          summary file (default sweep_results.txt)\n";
+}
+
+// False if the list is empty or an item is not a number
+bool parse_list(const char *text, std::vector<float> &values) {
+  values.clear();
+  float start, stop, step;
+  char tail;
+  if (std::sscanf(text, "%f:%f:%f%c", &start, &stop, &step, &tail) == 3 && step > 0) {
+    for (int i = 0; start + i * step <= stop + step * 1e-3f; ++i) {
+      values.push_back(start + i * step);
+    }
+    return !values.empty();
+  }
+  std::string list(text);
+  size_t begin = 0;
+  while (begin <= list.size()) {
+    size_t end = list.find(',', begin);
+    if (end == std::string::npos) {
+      end = list.size();
+    }
+    const std::string item = list.substr(begin, end - begin);
+    char *rest = nullptr;
+    const float value = std::strtof(item.c_str(), &rest);
+    if (item.empty() || *rest != '\0') {
+      return false;
+    }
+    values.push_back(value);
+    begin = end + 1;
+  }
+  return true;
+}
+
+struct SweepPoint {
+  SimConfig config;
+  SimResult result;
+  bool cached = false;
+};
+
+int main(int argc, char *argv[]) {
+  SimConfig base;
+  std::vector<float> angles = {base.steer_angle};
+  std::vector<float> freqs = {base.pulse_freq};
+  std::vector<float> refls = {base.refl_coef};
+  std::vector<float> wall_lengths = {base.wall_length};
+  std::vector<float> sizes = {static_cast<float>(base.width)};
+  unsigned threads = 0;
+  std::string cache_dir = "sweep_cache";
+  std::string out_path = "sweep_results.txt";
+
+  for (int i = 1; i < argc; ++i) {
+    const char *arg = argv[i];
+    if (i + 1 >= argc) {
+      print_usage();
+      return 1;
+    }
+    const char *value = argv[++i];
+    std::vector<float> *list = nullptr;
+    if (!std::strcmp(arg, "--angle")) {
+      list = &angles;
+    } else if (!std::strcmp(arg, "--freq")) {
+      list = &freqs;
+    } else if (!std::strcmp(arg, "--refl")) {
+      list = &refls;
+    } else if (!std::strcmp(arg, "--wall-length")) {
+      list = &wall_lengths;
+    } else if (!std::strcmp(arg, "--size")) {
+      list = &sizes;
+    } else if (!std::strcmp(arg, "--steps")) {
+      base.steps = std::atoi(value);
+      base.pulse_steps = base.steps;
+    } else if (!std::strcmp(arg, "--threads")) {
+      threads = std::atoi(value);
+    } else if (!std::strcmp(arg, "--cache")) {
+      cache_dir = value;
+    } else if (!std::strcmp(arg, "--out")) {
+      out_path = value;
+    } else {
+      print_usage();
+      return 1;
+    }
+    if (list && !parse_list(value, *list)) {
+      std::cerr << arg << " " << value << ": not a list of numbers\n";
+      return 1;
+    }
+  }
+
+  std::vector<SweepPoint> points;
+  int skipped = 0;
+  for (float angle : angles) {
+    for (float freq : freqs) {
+      for (float refl : refls) {
+        for (float wall_length : wall_lengths) {
+          for (float size : sizes) {
+            SweepPoint point;
+            point.config = base;
+            point.config.steer_angle = angle;
+            point.config.pulse_freq = freq;
+            point.config.refl_coef = refl;
+            point.config.wall_length = wall_length;
+            point.config.width = static_cast<int>(size);
+            point.config.height = static_cast<int>(size);
+            // Same geometry relative to the grid as the default size
+            const float scale = size / base.width;
+            point.config.lobe_radius = static_cast<int>(std::lround(base.lobe_radius * scale));
+            point.config.probe_x = static_cast<int>(std::lround(base.probe_x * scale));
+            if (const char *error = point.config.invalid()) {
+              std::cerr << "skipping angle " << angle << " freq " << freq << " refl "
+                        << refl << " wall_length " << wall_length << " size " << size
+                        << ": " << error << "\n";
+              ++skipped;
+              continue;
+            }
+            points.push_back(point);
+          }
+        }
+      }
+    }
+  }
+
+  ResultCache cache(cache_dir);
+  std::mutex print_mutex;
+  int done = 0;
+  {
+    WorkStealingPool pool(threads);
+    for (SweepPoint &point : points) {
+      pool.submit([&] {
+        point.cached = cache.load(point.config, point.result);
+        if (!point.cached) {
+          point.result = run_simulation(point.config);
+          cache.store(point.config, point.result);
+        }
+        std::lock_guard<std::mutex> lock(print_mutex);
+        std::cerr << "[" << ++done << "/" << points.size() << "] "
+                  << (point.cached ? "cached   " : "computed ")
+                  << cache.path(point.config) << "\n";
+      });
+    }
+    pool.wait();
+  }
+
+  std::ofstream outFile(out_path);
+  if (!outFile.is_open()) {
+    std::cerr << "Unable to open file for writing.\n";
+    return 1;
+  }
+  outFile << "# angle freq refl wall_length size peak_degree peak_pressure cache_file\n";
+  int computed = 0;
+  for (const SweepPoint &point : points) {
+    const std::vector<float> &lobes = point.result.lobes;
+    int peak = 0;
+    for (size_t i = 1; i < lobes.size(); ++i) {
+      if (lobes[i] > lobes[peak]) {
+        peak = static_cast<int>(i);
+      }
+    }
+    outFile << point.config.steer_angle << " " << point.config.pulse_freq << " "
+            << point.config.refl_coef << " " << point.config.wall_length << " "
+            << point.config.width << " " << peak << " "
+            << (lobes.empty() ? 0.0f : lobes[peak]) << " "
+            << cache.path(point.config) << "\n";
+    computed += point.cached ? 0 : 1;
+  }
+  std::cout << points.size() << " points, " << computed << " computed, "
+            << points.size() - computed << " from cache";
+  if (skipped > 0) {
+    std::cout << ", " << skipped << " invalid skipped";
+  }
+  std::cout << "\n";
+  return 0;
+}
@@ -0,0 +1,271 @@
+/*
+    telemetry.hpp
+
+    Live telemetry from a running simulation to other processes on the same
+    host, through a POSIX shared-memory ring buffer.
+
+    One TelemetryWriter (the solver) owns the segment. It publishes records
+    (probe samples, lobe patterns, downsampled field frames) into a ring of
+    fixed-size slots and never waits: when the ring is full it overwrites
+    the oldest slot. Any number of TelemetryReaders can attach and detach
+    at any time; they only read the segment, so they cannot slow the
+    writer down.
+
+    Record n goes to slot n % slot_count. Every slot has a sequence number
+    used as a seqlock: it is 2n + 1 while record n is being written and
+    2n + 2 once it is complete. A reader copies the slot and then checks
+    the sequence number again; if it changed, the writer lapped the reader
+    and the copy is thrown away and counted as lost. write_seq in the
+    header is the number of records published so far.
+
+    Layout: TelemetryHeader, then slot_count slots of slot_stride bytes,
+    each a TelemetrySlot followed by slot_floats floats of payload.
+*/
+#ifndef __SONAR_TELEMETRY_HPP
+#define __SONAR_TELEMETRY_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+// The sequence numbers are shared between processes, which only works if
+// the atomics are plain memory operations
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "telemetry needs lock-free 64-bit atomics");
+static_assert(std::atomic<uint32_t>::is_always_lock_free,
+              "telemetry needs lock-free 32-bit atomics");
+
+enum TelemetryType : uint32_t {
+  TELEMETRY_PROBE = 1, // count consecutive probe samples, starting at step
+  TELEMETRY_LOBES = 2, // lobe pressure at 0..count-1 degrees
+  TELEMETRY_FIELD = 3  // width x height pressure frame, row major
+};
+
+struct TelemetryRecord {
+  uint32_t type;
+  uint32_t count;  // floats of payload
+  uint32_t width;  // field frames only
+  uint32_t height; // field frames only
+  uint64_t step;   // simulation step of the (first) value
+  double time;     // simulated seconds at that step
+};
+
+struct TelemetryHeader {
+  static const uint32_t MAGIC = 0x534f4e52; // "SONR"
+  static const uint32_t VERSION = 1;
+
+  std::atomic<uint32_t> magic; // set last, once the segment is ready
+  uint32_t version;
+  uint32_t slot_count;
+  uint32_t slot_floats;
+  uint64_t slot_stride;
+  alignas(64) std::atomic<uint64_t> write_seq;
+};
+
+struct TelemetrySlot {
+  std::atomic<uint64_t> seq;
+  TelemetryRecord record;
+};
+
+class TelemetryWriter {
+public:
+  static const uint32_t DEFAULT_SLOTS = 256;
+  static const uint32_t DEFAULT_FLOATS = 4096;
+
+  // name is a shm_open name such as "/sonar_telemetry". A stale segment of
+  // the same name is replaced; readers still attached to it keep their
+  // mapping but see no new records.
+  explicit TelemetryWriter(const std::string &name,
+                           uint32_t slot_count = DEFAULT_SLOTS,
+                           uint32_t slot_floats = DEFAULT_FLOATS)
+      : name(name) {
+    const uint64_t stride =
+        (sizeof(TelemetrySlot) + slot_floats * sizeof(float) + 63) / 64 * 64;
+    bytes = sizeof(TelemetryHeader) + stride * slot_count;
+
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+      return;
+    }
+    if (ftruncate(fd, bytes) != 0) {
+      close(fd);
+      shm_unlink(name.c_str());
+      return;
+    }
+    void *mem = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED) {
+      shm_unlink(name.c_str());
+      return;
+    }
+    base = static_cast<char *>(mem);
+
+    // ftruncate zero-fills, so every slot starts with sequence number 0
+    header = new (base) TelemetryHeader{};
+    header->version = TelemetryHeader::VERSION;
+    header->slot_count = slot_count;
+    header->slot_floats = slot_floats;
+    header->slot_stride = stride;
+    header->write_seq.store(0, std::memory_order_relaxed);
+    for (uint32_t i = 0; i < slot_count; ++i) {
+      new (base + sizeof(TelemetryHeader) + i * stride) TelemetrySlot{};
+    }
+    header->magic.store(TelemetryHeader::MAGIC, std::memory_order_release);
+  }
+
+  ~TelemetryWriter() {
+    if (base) {
+      munmap(base, bytes);
+      shm_unlink(name.c_str());
+    }
+  }
+
+  TelemetryWriter(const TelemetryWriter &) = delete;
+  TelemetryWriter &operator=(const TelemetryWriter &) = delete;
+
+  bool is_open() const { return base != nullptr; }
+
+  // Copy one record into the ring. Returns false if there is no segment or
+  // the payload does not fit in a slot. Never blocks.
+  bool publish(const TelemetryRecord &record, const float *data) {
+    if (!base || record.count > header->slot_floats) {
+      return false;
+    }
+    const uint64_t n = next++;
+    TelemetrySlot *slot = slot_at(n % header->slot_count);
+    slot->seq.store(2 * n + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot->record = record;
+    std::memcpy(payload(slot), data, record.count * sizeof(float));
+    slot->seq.store(2 * n + 2, std::memory_order_release);
+    header->write_seq.store(n + 1, std::memory_order_release);
+    return true;
+  }
+
+private:
+  std::string name;
+  size_t bytes = 0;
+  char *base = nullptr;
+  TelemetryHeader *header = nullptr;
+  uint64_t next = 0; // only this process writes, so no atomic needed
+
+  TelemetrySlot *slot_at(uint64_t i) const {
+    return reinterpret_cast<TelemetrySlot *>(base + sizeof(TelemetryHeader) +
+                                             i * header->slot_stride);
+  }
+  static float *payload(TelemetrySlot *slot) {
+    return reinterpret_cast<float *>(slot + 1);
+  }
+};
+
+class TelemetryReader {
+public:
+  // Attaches read-only. Starts at the newest record unless from_oldest,
+  // in which case it first replays what is still in the ring.
+  explicit TelemetryReader(const std::string &name, bool from_oldest = false) {
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+      return;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 ||
+        static_cast<size_t>(info.st_size) < sizeof(TelemetryHeader)) {
+      close(fd);
+      return;
+    }
+    bytes = info.st_size;
+    void *mem = mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED) {
+      return;
+    }
+    base = static_cast<const char *>(mem);
+    header = reinterpret_cast<const TelemetryHeader *>(base);
+    // Only trust the geometry once the writer has finished setting it up
+    if (header->magic.load(std::memory_order_acquire) != TelemetryHeader::MAGIC ||
+        header->version != TelemetryHeader::VERSION ||
+        sizeof(TelemetryHeader) + header->slot_stride * header->slot_count > bytes) {
+      munmap(const_cast<char *>(base), bytes);
+      base = nullptr;
+      header = nullptr;
+      return;
+    }
+    cursor = header->write_seq.load(std::memory_order_acquire);
+    if (from_oldest) {
+      cursor = cursor > header->slot_count ? cursor - header->slot_count : 0;
+    }
+  }
+
+  ~TelemetryReader() {
+    if (base) {
+      munmap(const_cast<char *>(base), bytes);
+    }
+  }
+
+  TelemetryReader(const TelemetryReader &) = delete;
+  TelemetryReader &operator=(const TelemetryReader &) = delete;
+
+  bool is_open() const { return base != nullptr; }
+
+  // Records skipped because the writer overwrote them before they were read
+  uint64_t lost() const { return lost_records; }
+
+  // Copy the next record. Returns false when the reader has caught up.
+  bool next(TelemetryRecord &record, std::vector<float> &data) {
+    if (!base) {
+      return false;
+    }
+    for (;;) {
+      const uint64_t head = header->write_seq.load(std::memory_order_acquire);
+      if (cursor >= head) {
+        return false;
+      }
+      if (head - cursor > header->slot_count) {
+        // Fell more than a whole ring behind
+        lost_records += head - header->slot_count - cursor;
+        cursor = head - header->slot_count;
+      }
+      const TelemetrySlot *slot = slot_at(cursor % header->slot_count);
+      const uint64_t expected = 2 * cursor + 2;
+      const uint64_t before = slot->seq.load(std::memory_order_acquire);
+      if (before == expected) {
+        // The copy may race with the writer; the second load tells
+        record = slot->record;
+        const uint32_t count = std::min(record.count, header->slot_floats);
+        const float *values = reinterpret_cast<const float *>(slot + 1);
+        data.assign(values, values + count);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot->seq.load(std::memory_order_relaxed) == before) {
+          ++cursor;
+          return true;
+        }
+      }
+      // Overwritten by a newer lap
+      ++lost_records;
+      ++cursor;
+    }
+  }
+
+private:
+  size_t bytes = 0;
+  const char *base = nullptr;
+  const TelemetryHeader *header = nullptr;
+  uint64_t cursor = 0;
+  uint64_t lost_records = 0;
+
+  const TelemetrySlot *slot_at(uint64_t i) const {
+    return reinterpret_cast<const TelemetrySlot *>(base + sizeof(TelemetryHeader) +
+                                                   i * header->slot_stride);
+  }
+};
+
+#endif // __SONAR_TELEMETRY_HPP
@@ -0,0 +1,120 @@
+#include "telemetry.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Attach to a running simulation's telemetry and print the records as they
+// arrive. Detaching (Ctrl-C) at any time does not affect the simulation.
+//
+//   telemetry_tail [--name NAME] [--from-oldest] [--count N] [--probe-out FILE]
+//
+// --probe-out appends the probe samples to FILE in the output.txt format,
+// so display_pressure can open the stream of a run that is still going.
+
+void print_usage() {
+  std::cerr << "usage: telemetry_tail [options]\n"
+               "  --name NAME       shared memory name (default /sonar_telemetry)\n"
+               "  --from-oldest     replay what is still in the ring first\n"
+               "  --count N         exit after N records\n"
+               "  --probe-out FILE  append probe samples to FILE\n";
+}
+
+int main(int argc, char *argv[]) {
+  std::string name = "/sonar_telemetry";
+  bool from_oldest = false;
+  long count = -1;
+  std::string probe_path;
+  for (int i = 1; i < argc; ++i) {
+    const char *arg = argv[i];
+    if (!std::strcmp(arg, "--from-oldest")) {
+      from_oldest = true;
+    } else if (i + 1 < argc && !std::strcmp(arg, "--name")) {
+      name = argv[++i];
+    } else if (i + 1 < argc && !std::strcmp(arg, "--count")) {
+      count = std::atol(argv[++i]);
+    } else if (i + 1 < argc && !std::strcmp(arg, "--probe-out")) {
+      probe_path = argv[++i];
+    } else {
+      print_usage();
+      return 1;
+    }
+  }
+
+  // Wait for the simulation to start
+  std::unique_ptr<TelemetryReader> reader;
+  for (int tries = 0;; ++tries) {
+    reader = std::make_unique<TelemetryReader>(name, from_oldest);
+    if (reader->is_open()) {
+      break;
+    }
+    if (tries == 0) {
+      std::cerr << "waiting for " << name << " ...\n";
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  }
+
+  std::ofstream probeFile;
+  if (!probe_path.empty()) {
+    probeFile.open(probe_path, std::ios::app);
+    if (!probeFile.is_open()) {
+      std::cerr << "Unable to open " << probe_path << " for writing.\n";
+      return 1;
+    }
+  }
+
+  TelemetryRecord record;
+  std::vector<float> data;
+  uint64_t reported_lost = 0;
+  while (count != 0) {
+    if (!reader->next(record, data)) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      continue;
+    }
+    if (reader->lost() != reported_lost) {
+      std::cout << "lost " << reader->lost() - reported_lost << " records\n";
+      reported_lost = reader->lost();
+    }
+    if (count > 0) {
+      --count;
+    }
+
+    float lo = 0.0f;
+    float hi = 0.0f;
+    size_t peak = 0;
+    for (size_t i = 0; i < data.size(); ++i) {
+      lo = i ? std::min(lo, data[i]) : data[i];
+      hi = i ? std::max(hi, data[i]) : data[i];
+      peak = data[i] > data[peak] ? i : peak;
+    }
+    std::cout << "step " << record.step << " t " << record.time << " ";
+    switch (record.type) {
+    case TELEMETRY_PROBE:
+      std::cout << "probe " << data.size() << " samples [" << lo << ", " << hi << "]\n";
+      if (probeFile.is_open()) {
+        for (const float &num : data) {
+          probeFile << num << " ";
+        }
+        probeFile.flush();
+      }
+      break;
+    case TELEMETRY_LOBES:
+      std::cout << "lobes peak " << (data.empty() ? 0.0f : data[peak]) << " at "
+                << peak << " deg\n";
+      break;
+    case TELEMETRY_FIELD:
+      std::cout << "field " << record.width << "x" << record.height << " [" << lo
+                << ", " << hi << "]\n";
+      break;
+    default:
+      std::cout << "unknown record type " << record.type << "\n";
+    }
+  }
+  return 0;
+}
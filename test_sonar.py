@@ -0,0 +1,98 @@
+# Tests for the sonar Python module. Build it first, then run from here:
+#   python3 setup.py build_ext --inplace
+#   python3 test_sonar.py
+import threading
+import unittest
+
+import sonar
+
+
+class BufferViews(unittest.TestCase):
+    def test_shapes(self):
+        sim = sonar.Simulation(width=64, height=48, lobe_radius=20, probe=(20, 1))
+        sim.step(30)
+        field = sim.field
+        self.assertEqual(field.shape, (48, 64))
+        self.assertEqual(field.format, "f")
+        self.assertTrue(field.readonly)
+        self.assertEqual(sim.probe.shape, (30,))
+        self.assertEqual(sim.lobes.shape, (180,))
+        self.assertEqual(sim.steps, 30)
+
+    def test_views_see_later_steps(self):
+        sim = sonar.Simulation(width=64, height=48, lobe_radius=20, probe=(20, 1))
+        field = sim.field
+        self.assertEqual(max(abs(p) for p in field.cast("B").cast("f")), 0.0)
+        sim.step(30)
+        # Same buffer, refreshed by step()
+        self.assertGreater(max(abs(p) for p in field.cast("B").cast("f")), 0.0)
+
+    def test_read_only(self):
+        sim = sonar.Simulation(width=64, height=48, lobe_radius=20, probe=(20, 1))
+        with self.assertRaises(TypeError):
+            sim.field[0, 0] = 1.0
+
+
+class ExportLock(unittest.TestCase):
+    def test_full_probe_buffer_is_not_resized_while_exported(self):
+        sim = sonar.Simulation(width=64, height=48, lobe_radius=20, probe=(20, 1),
+                               probe_capacity=10)
+        sim.step(5)
+        view = sim.probe
+        with self.assertRaises(BufferError):
+            sim.step(10)
+        self.assertEqual(sim.steps, 5)
+        view.release()
+        sim.step(10)
+        self.assertEqual(sim.probe.shape, (15,))
+
+    def test_steps_within_capacity_while_exported(self):
+        sim = sonar.Simulation(width=64, height=48, lobe_radius=20, probe=(20, 1),
+                               probe_capacity=100)
+        view = sim.probe
+        sim.step(50)
+        self.assertEqual(sim.probe.shape, (50,))
+        view.release()
+
+
+class Stepping(unittest.TestCase):
+    def test_cell_mask_raises_while_stepping(self):
+        sim = sonar.Simulation(width=200, height=200)
+        self.assertEqual(len(sim.cell_mask()), 200 * 200)
+        worker = threading.Thread(target=sim.step, args=(20000,))
+        worker.start()
+        raised = False
+        while worker.is_alive() and not raised:
+            try:
+                sim.cell_mask()
+            except RuntimeError:
+                raised = True
+        worker.join()
+        self.assertTrue(raised)
+        self.assertEqual(len(sim.cell_mask()), 200 * 200)
+
+
+class InvalidConfig(unittest.TestCase):
+    def test_rejected(self):
+        bad = [
+            dict(width=8),
+            dict(sim_per_freq=1),
+            dict(lobe_radius=500),
+            dict(probe=(500, 1)),
+            dict(wave="square"),
+            dict(targets=[(1, 2, 3)]),
+            dict(probe_capacity=-1),
+        ]
+        for kwargs in bad:
+            with self.subTest(**{k: str(v) for k, v in kwargs.items()}):
+                with self.assertRaises(ValueError):
+                    sonar.Simulation(**kwargs)
+
+    def test_negative_steps(self):
+        sim = sonar.Simulation(width=64, height=48, lobe_radius=20, probe=(20, 1))
+        with self.assertRaises(ValueError):
+            sim.step(-1)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,216 @@
+/*
+    trace_pyramid.hpp
+
+    Multi-resolution min/max pyramid for long pressure traces.
+
+    Level 0 is the raw samples. Every entry of level L holds the min and
+    max of FACTOR entries of level L-1, so it covers FACTOR^L samples. The
+    pyramid is built while samples are appended, one block at a time, and
+    costs about 2 / (FACTOR - 1) extra floats per sample.
+
+    range() returns the min/max of any sample interval by reading the
+    coarsest level whose blocks are no larger than the interval, plus the
+    ragged ends at finer levels. A plot column is one range() call, so a
+    frame costs O(screen pixels) whatever the trace length or zoom.
+
+    TraceReader streams a whitespace separated text file (the format
+    main.cpp writes to output.txt) into a pyramid in bounded chunks, so a
+    viewer can show the trace while the rest is still loading.
+*/
+#ifndef __SONAR_TRACE_PYRAMID_HPP
+#define __SONAR_TRACE_PYRAMID_HPP
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+struct MinMax {
+  float lo;
+  float hi;
+
+  void add(const MinMax &other) {
+    lo = std::min(lo, other.lo);
+    hi = std::max(hi, other.hi);
+  }
+};
+
+class TracePyramid {
+public:
+  static const int FACTOR = 4;
+
+  void append(float sample) {
+    if (samples.empty()) {
+      total = MinMax{sample, sample};
+    }
+    total.add(MinMax{sample, sample});
+    samples.push_back(sample);
+    // Close the block of every level that this sample completes
+    size_t count = samples.size();
+    for (size_t l = 0; count % FACTOR == 0; ++l) {
+      if (l == levels.size()) {
+        levels.emplace_back();
+      }
+      count /= FACTOR;
+      levels[l].push_back(block_of(l, count - 1));
+    }
+  }
+
+  size_t size() const { return samples.size(); }
+  float sample(size_t i) const { return samples[i]; }
+
+  // Min/max over the whole trace; {0, 0} while empty
+  MinMax extent() const { return samples.empty() ? MinMax{0.0f, 0.0f} : total; }
+
+  // Min/max of samples [begin, end), clamped to the loaded samples.
+  // Returns false if that leaves no samples.
+  bool range(size_t begin, size_t end, MinMax &out) const {
+    end = std::min(end, samples.size());
+    if (begin >= end) {
+      return false;
+    }
+    out = MinMax{samples[begin], samples[begin]};
+    // Coarsest level whose blocks fit in the interval
+    size_t level = 0;
+    size_t span = 1;
+    while (level < levels.size() && span * FACTOR <= end - begin) {
+      span *= FACTOR;
+      ++level;
+    }
+    add_range(level, span, begin, end, out);
+    return true;
+  }
+
+private:
+  std::vector<float> samples;
+  // levels[l] covers FACTOR^(l + 1) samples per entry
+  std::vector<std::vector<MinMax>> levels;
+  MinMax total{0.0f, 0.0f};
+
+  // Entry i of pyramid level l + 1, made from its FACTOR children
+  MinMax block_of(size_t l, size_t i) const {
+    MinMax block;
+    if (l == 0) {
+      const float *first = &samples[i * FACTOR];
+      block = MinMax{first[0], first[0]};
+      for (int k = 1; k < FACTOR; ++k) {
+        block.add(MinMax{first[k], first[k]});
+      }
+    } else {
+      const MinMax *first = &levels[l - 1][i * FACTOR];
+      block = first[0];
+      for (int k = 1; k < FACTOR; ++k) {
+        block.add(first[k]);
+      }
+    }
+    return block;
+  }
+
+  // Whole blocks of this level inside [begin, end), then the ragged ends
+  // one level finer. Each level reads at most 2 * FACTOR entries.
+  void add_range(size_t level, size_t span, size_t begin, size_t end,
+                 MinMax &out) const {
+    if (level == 0) {
+      for (size_t i = begin; i < end; ++i) {
+        out.add(MinMax{samples[i], samples[i]});
+      }
+      return;
+    }
+    const std::vector<MinMax> &blocks = levels[level - 1];
+    size_t first = (begin + span - 1) / span;
+    size_t last = std::min(end / span, blocks.size());
+    if (first >= last) {
+      add_range(level - 1, span / FACTOR, begin, end, out);
+      return;
+    }
+    for (size_t b = first; b < last; ++b) {
+      out.add(blocks[b]);
+    }
+    add_range(level - 1, span / FACTOR, begin, first * span, out);
+    add_range(level - 1, span / FACTOR, last * span, end, out);
+  }
+};
+
+class TraceReader {
+public:
+  explicit TraceReader(const std::string &path)
+      : file(std::fopen(path.c_str(), "rb")) {
+    if (file) {
+      std::fseek(file, 0, SEEK_END);
+      file_size = std::ftell(file);
+      std::fseek(file, 0, SEEK_SET);
+    }
+  }
+  ~TraceReader() {
+    if (file) {
+      std::fclose(file);
+    }
+  }
+  TraceReader(const TraceReader &) = delete;
+  TraceReader &operator=(const TraceReader &) = delete;
+
+  bool is_open() const { return file != nullptr; }
+  bool done() const { return !file || finished; }
+
+  // Fraction of the file read so far
+  float progress() const {
+    return file_size > 0 ? static_cast<float>(bytes_read) / file_size : 1.0f;
+  }
+
+  // Parse up to max_bytes more of the file into the pyramid
+  void read(TracePyramid &pyramid, size_t max_bytes) {
+    while (!done() && max_bytes > 0) {
+      // Keep the unfinished number from the last chunk in front
+      const size_t chunk = std::min(max_bytes, CHUNK_SIZE);
+      buffer.resize(carry.size() + chunk + 1);
+      std::copy(carry.begin(), carry.end(), buffer.begin());
+      size_t got = std::fread(&buffer[carry.size()], 1, chunk, file);
+      bytes_read += got;
+      max_bytes -= std::min(max_bytes, chunk);
+      finished = got < chunk;
+      size_t length = carry.size() + got;
+      buffer[length] = '\0';
+
+      // Only parse up to the last separator unless this is the end
+      size_t parse_end = length;
+      if (!finished) {
+        while (parse_end > 0 && !is_space(buffer[parse_end - 1])) {
+          --parse_end;
+        }
+      }
+      carry.assign(buffer.begin() + parse_end, buffer.begin() + length);
+      buffer[parse_end] = '\0';
+
+      char *cursor = buffer.data();
+      char *stop = buffer.data() + parse_end;
+      while (cursor < stop) {
+        char *next;
+        float value = std::strtof(cursor, &next);
+        if (next == cursor) {
+          // Skip anything that is not a number
+          ++cursor;
+          continue;
+        }
+        pyramid.append(value);
+        cursor = next;
+      }
+    }
+  }
+
+private:
+  static constexpr size_t CHUNK_SIZE = 1 << 20;
+
+  std::FILE *file;
+  long file_size = 0;
+  size_t bytes_read = 0;
+  bool finished = false;
+  std::vector<char> buffer;
+  std::vector<char> carry;
+
+  static bool is_space(char c) {
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r';
+  }
+};
+
+#endif // __SONAR_TRACE_PYRAMID_HPP
@@ -11,6 +11,7 @@
 #ifndef __COSINEKITTY_WATERPOOL_HPP
 #define __COSINEKITTY_WATERPOOL_HPP
 
+#include "worker_pool.hpp"
 #include <cmath>
 #include <iostream>
 #include <vector>
@@ -88,6 +89,92 @@ public:
     }
   }
 };
+
+/*
+    FastWaterPool runs the same model as WaterPool, but is laid out for speed:
+
+    - structure-of-arrays storage, so each pass streams plain float rows;
+    - a one-cell ghost border that is always dry (wet = 0), so a neighbour
+      outside the pool contributes nothing without any bounds checks;
+    - acceleration, velocity and position in one fused row-major pass,
+      reading positions from one buffer and writing the next into another;
+    - rows split in bands across a WorkerPool when the pool is large enough.
+
+    The result matches WaterPool::update to within float rounding.
+*/
+template <int WIDTH, int HEIGHT> class FastWaterPool {
+private:
+  static_assert(WIDTH > 0, "Width must be a positive integer.");
+  static_assert(HEIGHT > 0, "Height must be a positive integer.");
+  static const int STRIDE = WIDTH + 2;
+  static const int SIZE = STRIDE * (HEIGHT + 2);
+
+  std::vector<float> wet = std::vector<float>(SIZE, 0.0f);
+  std::vector<float> pos[2] = {std::vector<float>(SIZE, 0.0f),
+                               std::vector<float>(SIZE, 0.0f)};
+  std::vector<float> vel = std::vector<float>(SIZE, 0.0f);
+  int current = 0;
+  WorkerPool workers;
+
+  static constexpr int index(int i, int j) {
+    // skip the ghost border
+    return (j + 1) * STRIDE + (i + 1);
+  }
+
+  void update_rows(int j0, int j1, float dt, float damp, float k) {
+    const float *__restrict w = wet.data();
+    const float *__restrict p = pos[current].data();
+    float *__restrict q = pos[1 - current].data();
+    float *__restrict v = vel.data();
+
+    for (int j = j0; j < j1; ++j) {
+      const int row = index(0, j);
+      for (int c = row; c < row + WIDTH; ++c) {
+        const float h = p[c];
+        const float acc =
+            k * (w[c + STRIDE] * (p[c + STRIDE] - h) +
+                 w[c - STRIDE] * (p[c - STRIDE] - h) +
+                 w[c - 1] * (p[c - 1] - h) + w[c + 1] * (p[c + 1] - h));
+        const float nv = (damp * v[c]) + (dt * acc);
+        const bool active = w[c] > 0.0f;
+        v[c] = active ? nv : v[c];
+        q[c] = active ? h + (dt * nv) : h;
+      }
+    }
+  }
+
+public:
+  // threads == 0 uses every core; small pools always run single-threaded.
+  explicit FastWaterPool(unsigned threads = 0)
+      : workers(WorkerPool::threads_for(WIDTH * HEIGHT, threads)) {
+    for (int j = 0; j < HEIGHT; ++j) {
+      for (int i = 0; i < WIDTH; ++i) {
+        wet[index(i, j)] = 1.0f;
+      }
+    }
+  }
+
+  WaterCell getCell(int i, int j) const {
+    WaterCell cell;
+    cell.wet = wet[index(i, j)];
+    cell.pos = pos[current][index(i, j)];
+    cell.vel = vel[index(i, j)];
+    return cell;
+  }
+
+  void setWet(int i, int j, float value) { wet[index(i, j)] = value; }
+  void setPos(int i, int j, float value) { pos[current][index(i, j)] = value; }
+  void setVel(int i, int j, float value) { vel[index(i, j)] = value; }
+
+  void update(float dt, float halflife, float k) {
+    const float damp = pow(0.5, dt / halflife);
+
+    workers.parallel_for(HEIGHT, [&](int j0, int j1) {
+      update_rows(j0, j1, dt, damp, k);
+    });
+    current = 1 - current;
+  }
+};
 } // namespace Sapphire
 
 #endif // __COSINEKITTY_WATERPOOL_HPP
@@ -0,0 +1,96 @@
+#include "waterpool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+// Checks FastWaterPool against the plain WaterPool: the same wet mask
+// (the barriers of animate.cpp) and the same impulses, then the positions
+// are compared every step. The fast pool runs once on one thread and once
+// split into bands over four threads. Prints ms per step for each pool
+// and exits non-zero if the largest difference exceeds TOLERANCE times
+// the peak displacement.
+//
+//   waterpool_check [STEPS]
+
+using namespace Sapphire;
+
+const int WIDTH = 320; // 320 x 256 is over PARALLEL_MIN_CELLS, so four
+const int HEIGHT = 256; // threads really split the rows
+const float TOLERANCE = 1e-5f;
+
+template <class Pool> void set_wet(Pool &pool, int i, int j) {
+  pool.getCell(i, j).wet = 0.0f;
+}
+
+template <int W, int H> void set_wet(FastWaterPool<W, H> &pool, int i, int j) {
+  pool.setWet(i, j, 0.0f);
+}
+
+template <class Pool> void add_barriers(Pool &pool) {
+  for (int i = 30; i + 10 < WIDTH; ++i) {
+    set_wet(pool, i, HEIGHT / 2 - 7);
+    set_wet(pool, i - 13, HEIGHT / 2 + 17);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  const int steps = argc > 1 ? std::atoi(argv[1]) : 2000;
+  const float dt = 1.0f / 48000.0f;
+  const float halflife = 0.07f;
+  const float c = 10.0f;
+  const float s = 0.001f;
+  const float k = (c * c) / (s * s);
+
+  WaterPool<WIDTH, HEIGHT> reference;
+  FastWaterPool<WIDTH, HEIGHT> single(1);
+  FastWaterPool<WIDTH, HEIGHT> banded(4);
+  add_barriers(reference);
+  add_barriers(single);
+  add_barriers(banded);
+
+  double seconds[3] = {0.0, 0.0, 0.0};
+  float worst = 0.0f;
+  float peak = 0.0f;
+  for (int step = 0; step < steps; ++step) {
+    // A new impulse every 250 steps, at a different place each time
+    if (step % 250 == 0) {
+      const int i = 20 + (step / 250 * 37) % (WIDTH - 40);
+      const int j = 20 + (step / 250 * 53) % (HEIGHT - 40);
+      reference.getCell(i, j).vel = 5000.0f;
+      single.setVel(i, j, 5000.0f);
+      banded.setVel(i, j, 5000.0f);
+    }
+    auto t0 = std::chrono::steady_clock::now();
+    reference.update(dt, halflife, k);
+    auto t1 = std::chrono::steady_clock::now();
+    single.update(dt, halflife, k);
+    auto t2 = std::chrono::steady_clock::now();
+    banded.update(dt, halflife, k);
+    auto t3 = std::chrono::steady_clock::now();
+    seconds[0] += std::chrono::duration<double>(t1 - t0).count();
+    seconds[1] += std::chrono::duration<double>(t2 - t1).count();
+    seconds[2] += std::chrono::duration<double>(t3 - t2).count();
+
+    for (int j = 0; j < HEIGHT; ++j) {
+      for (int i = 0; i < WIDTH; ++i) {
+        const float pos = reference.getCell(i, j).pos;
+        peak = std::max(peak, std::fabs(pos));
+        worst = std::max(worst, std::fabs(single.getCell(i, j).pos - pos));
+        worst = std::max(worst, std::fabs(banded.getCell(i, j).pos - pos));
+      }
+    }
+  }
+
+  std::cout << steps << " steps on " << WIDTH << " x " << HEIGHT
+            << ", ms per step: WaterPool " << 1e3 * seconds[0] / steps
+            << ", FastWaterPool " << 1e3 * seconds[1] / steps << ", 4 threads "
+            << 1e3 * seconds[2] / steps << "\n"
+            << "largest difference " << worst << " (peak " << peak << ")\n";
+  if (!(worst <= TOLERANCE * peak)) {
+    std::cerr << "FastWaterPool does not match WaterPool\n";
+    return 1;
+  }
+  return 0;
+}
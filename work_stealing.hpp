@@ -0,0 +1,169 @@
+/*
+    work_stealing.hpp
+
+    Thread pool for many independent, coarse jobs (whole simulations).
+    Every worker owns a deque. A worker takes its newest task first and,
+    when its own deque is empty, steals the oldest task from another worker.
+    Long and short jobs then balance out on their own, with no central
+    queue for every thread to fight over.
+*/
+#ifndef __SONAR_WORK_STEALING_HPP
+#define __SONAR_WORK_STEALING_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkStealingPool {
+public:
+  // threads == 0 picks one thread per core
+  explicit WorkStealingPool(unsigned threads = 0) {
+    if (threads == 0) {
+      threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (unsigned t = 0; t < threads; ++t) {
+      queues.emplace_back(new Queue);
+    }
+    for (unsigned t = 0; t < threads; ++t) {
+      workers.emplace_back([this, t] { worker_loop(t); });
+    }
+  }
+
+  ~WorkStealingPool() {
+    wait();
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &worker : workers) {
+      worker.join();
+    }
+  }
+
+  WorkStealingPool(const WorkStealingPool &) = delete;
+  WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+  unsigned size() const { return static_cast<unsigned>(workers.size()); }
+
+  // Queue a task. Tasks submitted from a worker go to that worker's own
+  // deque; the others are dealt round-robin.
+  void submit(std::function<void()> task) {
+    unsigned target = current_worker().pool == this
+                          ? current_worker().index
+                          : next_queue++ % size();
+    {
+      // Pending before it is visible, so wait() can't see pending == 0
+      // while the task is still on its way into a deque
+      std::lock_guard<std::mutex> lock(mutex);
+      ++pending;
+    }
+    {
+      std::lock_guard<std::mutex> lock(queues[target]->mutex);
+      queues[target]->tasks.push_back(std::move(task));
+    }
+    {
+      // Queued only once it is in a deque, so a worker that claims it
+      // finds it there
+      std::lock_guard<std::mutex> lock(mutex);
+      ++queued;
+    }
+    wake.notify_one();
+  }
+
+  // Block until every submitted task, including ones submitted by tasks,
+  // has finished
+  void wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [this] { return pending == 0; });
+  }
+
+private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  struct WorkerId {
+    const WorkStealingPool *pool = nullptr;
+    unsigned index = 0;
+  };
+
+  std::vector<std::unique_ptr<Queue>> queues;
+  std::vector<std::thread> workers;
+  std::mutex mutex; // guards queued, pending and stopping
+  std::condition_variable wake;
+  std::condition_variable idle;
+  long queued = 0;  // tasks in some deque that no worker has claimed
+  long pending = 0; // tasks queued or running
+  bool stopping = false;
+  std::atomic<unsigned> next_queue{0};
+
+  static WorkerId &current_worker() {
+    static thread_local WorkerId id;
+    return id;
+  }
+
+  bool pop_own(unsigned t, std::function<void()> &task) {
+    Queue &q = *queues[t];
+    std::lock_guard<std::mutex> lock(q.mutex);
+    if (q.tasks.empty()) {
+      return false;
+    }
+    task = std::move(q.tasks.back());
+    q.tasks.pop_back();
+    return true;
+  }
+
+  bool steal(unsigned t, std::function<void()> &task) {
+    for (unsigned i = 1; i < size(); ++i) {
+      Queue &q = *queues[(t + i) % size()];
+      std::lock_guard<std::mutex> lock(q.mutex);
+      if (!q.tasks.empty()) {
+        task = std::move(q.tasks.front());
+        q.tasks.pop_front();
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void worker_loop(unsigned t) {
+    current_worker().pool = this;
+    current_worker().index = t;
+    while (true) {
+      {
+        // Idle workers sleep here; each wakeup claims one queued task
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [this] { return queued > 0 || stopping; });
+        if (queued == 0 && stopping) {
+          return;
+        }
+        --queued;
+      }
+      // Every claim has a task in some deque. The scan can only miss it if
+      // another claimant took it while a newer task landed in a deque
+      // already scanned, so this retries rarely and briefly.
+      std::function<void()> task;
+      while (!pop_own(t, task) && !steal(t, task)) {
+        std::this_thread::yield();
+      }
+      task();
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        --pending;
+        if (pending == 0) {
+          idle.notify_all();
+        }
+      }
+    }
+  }
+};
+
+#endif // __SONAR_WORK_STEALING_HPP
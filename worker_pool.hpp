@@ -0,0 +1,124 @@
+/*
+    worker_pool.hpp
+
+    Persistent pool of threads for splitting a grid update into bands of
+    rows. The threads are started once and woken for every parallel_for,
+    so it is cheap enough to call once per simulation step.
+*/
+#ifndef __SONAR_WORKER_POOL_HPP
+#define __SONAR_WORKER_POOL_HPP
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkerPool {
+public:
+  // threads == 0 picks one thread per core. The calling thread always takes
+  // part, so a pool of size 1 starts no threads at all.
+  explicit WorkerPool(unsigned threads = 0) {
+    if (threads == 0) {
+      threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (unsigned t = 1; t < threads; ++t) {
+      workers.emplace_back([this, t] { worker_loop(t); });
+    }
+  }
+
+  ~WorkerPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+      ++generation;
+    }
+    wake.notify_all();
+    for (std::thread &worker : workers) {
+      worker.join();
+    }
+  }
+
+  // Below this many cells the threads cost more than they save
+  static const long PARALLEL_MIN_CELLS = 256 * 256;
+
+  // Pool size for a grid of cells cells: threads as given, or 1 for grids
+  // too small to be worth splitting
+  static unsigned threads_for(long cells, unsigned threads) {
+    return cells >= PARALLEL_MIN_CELLS ? threads : 1;
+  }
+
+  WorkerPool(const WorkerPool &) = delete;
+  WorkerPool &operator=(const WorkerPool &) = delete;
+
+  unsigned size() const { return static_cast<unsigned>(workers.size()) + 1; }
+
+  // Call fn(begin, end) on contiguous chunks covering [0, count) and wait
+  // until every chunk is done.
+  void parallel_for(int count, const std::function<void(int, int)> &fn) {
+    if (workers.empty() || count < 2) {
+      fn(0, count);
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      job = &fn;
+      job_count = count;
+      pending = static_cast<int>(workers.size());
+      ++generation;
+    }
+    wake.notify_all();
+    run_chunk(0, fn, count);
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] { return pending == 0; });
+    job = nullptr;
+  }
+
+private:
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable done;
+  const std::function<void(int, int)> *job = nullptr;
+  int job_count = 0;
+  int pending = 0;
+  unsigned long generation = 0;
+  bool stopping = false;
+
+  void run_chunk(unsigned t, const std::function<void(int, int)> &fn,
+                 int count) const {
+    const unsigned n = size();
+    int begin = static_cast<int>((static_cast<long>(count) * t) / n);
+    int end = static_cast<int>((static_cast<long>(count) * (t + 1)) / n);
+    if (begin < end) {
+      fn(begin, end);
+    }
+  }
+
+  void worker_loop(unsigned t) {
+    unsigned long seen = 0;
+    while (true) {
+      const std::function<void(int, int)> *fn;
+      int count;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [&] { return generation != seen; });
+        seen = generation;
+        if (stopping) {
+          return;
+        }
+        fn = job;
+        count = job_count;
+      }
+      run_chunk(t, *fn, count);
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        --pending;
+      }
+      done.notify_one();
+    }
+  }
+};
+
+#endif // __SONAR_WORKER_POOL_HPP